@@ -103,6 +103,7 @@
 #define CCM_AHB_GATING_USB0	(1 << 0)
 #define CCM_AHB_GATING_EHCI0	(1 << 1)
 #define CCM_AHB_GATING_EHCI1	(1 << 3)
+#define CCM_AHB_GATING_DMA	(1 << 6)
 #define CCM_AHB_GATING_EMAC	(1 << 17)
 
 #define CCM_USB_PHY		(1 << 8)
@@ -113,5 +114,6 @@
 int a10_clk_usb_activate(void);
 int a10_clk_usb_deactivate(void);
 int a10_clk_emac_activate(void);
+int a10_clk_dmac_activate(void);
 
 #endif /* _A10_CLK_H_ */
@@ -0,0 +1,328 @@
+/*-
+ * Copyright (c) 2015 The FreeBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * A10/A20 DMA controller.
+ *
+ * Only the dedicated DMA (DDMA) channels are supported.  They are the ones
+ * wired to the DRQ lines of the on-chip peripherals such as EMAC.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/bus.h>
+#include <sys/kernel.h>
+#include <sys/module.h>
+#include <sys/lock.h>
+#include <sys/mutex.h>
+#include <sys/rman.h>
+#include <machine/bus.h>
+#include <machine/intr.h>
+
+#include <dev/fdt/fdt_common.h>
+#include <dev/ofw/openfirm.h>
+#include <dev/ofw/ofw_bus.h>
+#include <dev/ofw/ofw_bus_subr.h>
+
+#include "a10_clk.h"
+#include "a10_dmac.h"
+
+#define	DMA_IRQ_EN_REG		0x0000
+#define	DMA_IRQ_PEND_STA_REG	0x0004
+
+#define	DMA_IRQ_DDMA_HF(n)	(1U << (((n) * 2) + 16))
+#define	DMA_IRQ_DDMA_END(n)	(1U << (((n) * 2) + 17))
+#define	DMA_IRQ_DDMA		0xffff0000
+
+#define	DDMA_NCHANNELS		8
+#define	DDMA_REG(n, reg)	(0x300 + 0x20 * (n) + (reg))
+#define	DDMA_CTL		0x00
+#define	DDMA_SRC_ADDR		0x04
+#define	DDMA_DST_ADDR		0x08
+#define	DDMA_BC			0x0c
+#define	DDMA_PARA		0x18
+
+#define	DDMA_CTL_LOADING	(1U << 31)
+#define	DDMA_CTL_BUSY		(1U << 30)
+#define	DDMA_CTL_DST_WIDTH(x)	((x) << 25)
+#define	DDMA_CTL_DST_BURST(x)	((x) << 23)
+#define	DDMA_CTL_DST_MODE(x)	((x) << 21)
+#define	DDMA_CTL_DST_DRQ(x)	((x) << 16)
+#define	DDMA_CTL_BC_REMAIN	(1U << 15)
+#define	DDMA_CTL_SRC_WIDTH(x)	((x) << 9)
+#define	DDMA_CTL_SRC_BURST(x)	((x) << 7)
+#define	DDMA_CTL_SRC_MODE(x)	((x) << 5)
+#define	DDMA_CTL_SRC_DRQ(x)	((x) << 0)
+
+/* Data block size 32, wait 8 cycles on both sides */
+#define	DDMA_PARA_DEFAULT	((31 << 24) | (7 << 16) | (31 << 8) | 7)
+
+struct a10_dmac_channel {
+	struct a10_dmac_softc	*ch_sc;
+	u_int			ch_index;
+	int			ch_busy;
+	int			ch_running;	/* callbacks in flight */
+	a10_dmac_callback_t	ch_callback;
+	void			*ch_arg;
+};
+
+struct a10_dmac_softc {
+	struct resource		*res[2];
+	bus_space_tag_t		bst;
+	bus_space_handle_t	bsh;
+	void			*ih;
+	struct mtx		mtx;
+	struct a10_dmac_channel	ddma[DDMA_NCHANNELS];
+};
+
+static struct a10_dmac_softc *a10_dmac_sc;
+
+static struct resource_spec a10_dmac_spec[] = {
+	{ SYS_RES_MEMORY,	0,	RF_ACTIVE },
+	{ SYS_RES_IRQ,		0,	RF_ACTIVE },
+	{ -1, 0 }
+};
+
+#define	dmac_read_4(sc, reg)		\
+    bus_space_read_4((sc)->bst, (sc)->bsh, (reg))
+#define	dmac_write_4(sc, reg, val)	\
+    bus_space_write_4((sc)->bst, (sc)->bsh, (reg), (val))
+
+static void
+a10_dmac_intr(void *arg)
+{
+	struct a10_dmac_softc *sc = arg;
+	struct a10_dmac_channel *ch;
+	a10_dmac_callback_t callback;
+	void *cbarg;
+	uint32_t sta;
+	u_int i;
+
+	sta = dmac_read_4(sc, DMA_IRQ_PEND_STA_REG);
+	dmac_write_4(sc, DMA_IRQ_PEND_STA_REG, sta);
+
+	for (i = 0; i < DDMA_NCHANNELS; i++) {
+		if ((sta & DMA_IRQ_DDMA_END(i)) == 0)
+			continue;
+		ch = &sc->ddma[i];
+
+		/*
+		 * Take a snapshot of the callback and mark it running so
+		 * that a10_dmac_free() cannot release the channel under it.
+		 */
+		mtx_lock(&sc->mtx);
+		callback = ch->ch_callback;
+		cbarg = ch->ch_arg;
+		if (callback != NULL)
+			ch->ch_running++;
+		mtx_unlock(&sc->mtx);
+		if (callback == NULL)
+			continue;
+
+		callback(cbarg);
+
+		mtx_lock(&sc->mtx);
+		if (--ch->ch_running == 0)
+			wakeup(ch);
+		mtx_unlock(&sc->mtx);
+	}
+}
+
+static int
+a10_dmac_probe(device_t dev)
+{
+
+	if (!ofw_bus_status_okay(dev))
+		return (ENXIO);
+
+	if (!ofw_bus_is_compatible(dev, "allwinner,sun4i-dma"))
+		return (ENXIO);
+
+	device_set_desc(dev, "Allwinner DMA controller");
+	return (BUS_PROBE_DEFAULT);
+}
+
+static int
+a10_dmac_attach(device_t dev)
+{
+	struct a10_dmac_softc *sc = device_get_softc(dev);
+	u_int i;
+
+	if (a10_dmac_sc)
+		return (ENXIO);
+
+	if (bus_alloc_resources(dev, a10_dmac_spec, sc->res)) {
+		device_printf(dev, "could not allocate resources\n");
+		return (ENXIO);
+	}
+
+	sc->bst = rman_get_bustag(sc->res[0]);
+	sc->bsh = rman_get_bushandle(sc->res[0]);
+	mtx_init(&sc->mtx, "a10 dmac", NULL, MTX_DEF);
+
+	for (i = 0; i < DDMA_NCHANNELS; i++) {
+		sc->ddma[i].ch_sc = sc;
+		sc->ddma[i].ch_index = i;
+	}
+
+	a10_clk_dmac_activate();
+
+	/* Mask and acknowledge everything before hooking the interrupt. */
+	dmac_write_4(sc, DMA_IRQ_EN_REG, 0);
+	dmac_write_4(sc, DMA_IRQ_PEND_STA_REG, ~0);
+
+	if (bus_setup_intr(dev, sc->res[1], INTR_TYPE_MISC | INTR_MPSAFE,
+	    NULL, a10_dmac_intr, sc, &sc->ih)) {
+		device_printf(dev, "could not setup interrupt handler\n");
+		bus_release_resources(dev, a10_dmac_spec, sc->res);
+		mtx_destroy(&sc->mtx);
+		return (ENXIO);
+	}
+
+	a10_dmac_sc = sc;
+
+	return (0);
+}
+
+static device_method_t a10_dmac_methods[] = {
+	DEVMETHOD(device_probe,		a10_dmac_probe),
+	DEVMETHOD(device_attach,	a10_dmac_attach),
+	{ 0, 0 }
+};
+
+static driver_t a10_dmac_driver = {
+	"a10_dmac",
+	a10_dmac_methods,
+	sizeof(struct a10_dmac_softc),
+};
+
+static devclass_t a10_dmac_devclass;
+
+DRIVER_MODULE(a10_dmac, simplebus, a10_dmac_driver, a10_dmac_devclass, 0, 0);
+
+struct a10_dmac_channel *
+a10_dmac_alloc(a10_dmac_callback_t callback, void *arg)
+{
+	struct a10_dmac_softc *sc = a10_dmac_sc;
+	struct a10_dmac_channel *ch;
+	uint32_t reg_value;
+	u_int i;
+
+	if (sc == NULL)
+		return (NULL);
+
+	ch = NULL;
+	mtx_lock(&sc->mtx);
+	for (i = 0; i < DDMA_NCHANNELS; i++) {
+		if (sc->ddma[i].ch_busy == 0) {
+			ch = &sc->ddma[i];
+			ch->ch_busy = 1;
+			ch->ch_callback = callback;
+			ch->ch_arg = arg;
+			break;
+		}
+	}
+	if (ch != NULL) {
+		reg_value = dmac_read_4(sc, DMA_IRQ_EN_REG);
+		reg_value |= DMA_IRQ_DDMA_END(ch->ch_index);
+		dmac_write_4(sc, DMA_IRQ_EN_REG, reg_value);
+	}
+	mtx_unlock(&sc->mtx);
+
+	return (ch);
+}
+
+void
+a10_dmac_free(struct a10_dmac_channel *ch)
+{
+	struct a10_dmac_softc *sc = ch->ch_sc;
+	uint32_t reg_value;
+
+	a10_dmac_halt(ch);
+
+	mtx_lock(&sc->mtx);
+	reg_value = dmac_read_4(sc, DMA_IRQ_EN_REG);
+	reg_value &= ~(DMA_IRQ_DDMA_HF(ch->ch_index) |
+	    DMA_IRQ_DDMA_END(ch->ch_index));
+	dmac_write_4(sc, DMA_IRQ_EN_REG, reg_value);
+	ch->ch_callback = NULL;
+	ch->ch_arg = NULL;
+	/* Wait for a callback the interrupt handler already picked up. */
+	while (ch->ch_running != 0)
+		mtx_sleep(ch, &sc->mtx, 0, "dmacfr", 0);
+	ch->ch_busy = 0;
+	mtx_unlock(&sc->mtx);
+}
+
+int
+a10_dmac_transfer(struct a10_dmac_channel *ch,
+    const struct a10_dmac_config *conf, bus_addr_t src, bus_addr_t dst,
+    bus_size_t nbytes)
+{
+	struct a10_dmac_softc *sc = ch->ch_sc;
+	u_int n = ch->ch_index;
+	uint32_t ctl;
+
+	if (dmac_read_4(sc, DDMA_REG(n, DDMA_CTL)) & DDMA_CTL_BUSY)
+		return (EBUSY);
+
+	ctl = DDMA_CTL_DST_WIDTH(conf->dst_width) |
+	    DDMA_CTL_DST_BURST(conf->dst_burst) |
+	    DDMA_CTL_DST_MODE(conf->dst_mode) |
+	    DDMA_CTL_DST_DRQ(conf->dst_drq) |
+	    DDMA_CTL_SRC_WIDTH(conf->src_width) |
+	    DDMA_CTL_SRC_BURST(conf->src_burst) |
+	    DDMA_CTL_SRC_MODE(conf->src_mode) |
+	    DDMA_CTL_SRC_DRQ(conf->src_drq);
+
+	dmac_write_4(sc, DDMA_REG(n, DDMA_SRC_ADDR), (uint32_t)src);
+	dmac_write_4(sc, DDMA_REG(n, DDMA_DST_ADDR), (uint32_t)dst);
+	dmac_write_4(sc, DDMA_REG(n, DDMA_BC), (uint32_t)nbytes);
+	dmac_write_4(sc, DDMA_REG(n, DDMA_PARA), DDMA_PARA_DEFAULT);
+	dmac_write_4(sc, DDMA_REG(n, DDMA_CTL), ctl);
+	dmac_write_4(sc, DDMA_REG(n, DDMA_CTL), ctl | DDMA_CTL_LOADING);
+
+	return (0);
+}
+
+void
+a10_dmac_halt(struct a10_dmac_channel *ch)
+{
+	struct a10_dmac_softc *sc = ch->ch_sc;
+	u_int n = ch->ch_index;
+	uint32_t reg_value;
+
+	reg_value = dmac_read_4(sc, DDMA_REG(n, DDMA_CTL));
+	reg_value &= ~DDMA_CTL_LOADING;
+	dmac_write_4(sc, DDMA_REG(n, DDMA_CTL), reg_value);
+	dmac_write_4(sc, DMA_IRQ_PEND_STA_REG, DMA_IRQ_DDMA_HF(n) |
+	    DMA_IRQ_DDMA_END(n));
+}
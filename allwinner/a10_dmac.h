@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2015 The FreeBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef	_A10_DMAC_H_
+#define	_A10_DMAC_H_
+
+/* Dedicated DMA DRQ types */
+#define	A10_DDMA_DRQ_SRAM	0
+#define	A10_DDMA_DRQ_SDRAM	1
+#define	A10_DDMA_DRQ_EMAC_TX	6
+#define	A10_DDMA_DRQ_EMAC_RX	7
+
+/* Address modes */
+#define	A10_DDMA_ADDR_LINEAR	0
+#define	A10_DDMA_ADDR_IO	1
+
+/* Data widths */
+#define	A10_DMA_WIDTH_8		0
+#define	A10_DMA_WIDTH_16	1
+#define	A10_DMA_WIDTH_32	2
+
+/* Burst lengths */
+#define	A10_DMA_BURST_1		0
+#define	A10_DMA_BURST_4		1
+#define	A10_DMA_BURST_8		2
+
+struct a10_dmac_config {
+	u_int	src_drq;
+	u_int	src_mode;
+	u_int	src_width;
+	u_int	src_burst;
+	u_int	dst_drq;
+	u_int	dst_mode;
+	u_int	dst_width;
+	u_int	dst_burst;
+};
+
+struct a10_dmac_channel;
+
+typedef void (*a10_dmac_callback_t)(void *);
+
+/*
+ * The callback runs from the DMA controller's interrupt thread.
+ * a10_dmac_free() waits for a running callback to return, so it must not
+ * be called from the callback or with a lock the callback takes.
+ */
+struct a10_dmac_channel *a10_dmac_alloc(a10_dmac_callback_t, void *);
+void	a10_dmac_free(struct a10_dmac_channel *);
+int	a10_dmac_transfer(struct a10_dmac_channel *,
+	    const struct a10_dmac_config *, bus_addr_t, bus_addr_t, bus_size_t);
+void	a10_dmac_halt(struct a10_dmac_channel *);
+
+#endif
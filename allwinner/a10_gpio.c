@@ -72,6 +72,16 @@ __FBSDID("$FreeBSD: head/sys/arm/allwinner/a10_gpio.c 281085 2015-04-04 21:34:26
 
 #define A10_GPIO_INPUT		0
 #define A10_GPIO_OUTPUT		1
+#define A10_GPIO_EINT_FUNC	6
+
+/* EINT0 - EINT21 are on PH0 - PH21, EINT22 - EINT31 on PI10 - PI19. */
+#define	A10_GPIO_EINTS		32
+
+struct a10_gpio_eint {
+	void			(*ei_handler)(void *);
+	void			*ei_arg;
+	int			ei_running;	/* handlers in flight */
+};
 
 struct a10_gpio_softc {
 	device_t		sc_dev;
@@ -84,6 +94,7 @@ struct a10_gpio_softc {
 	void *			sc_intrhand;
 	int			sc_gpio_npins;
 	struct gpio_pin		sc_gpio_pins[A10_GPIO_PINS];
+	struct a10_gpio_eint	sc_eint[A10_GPIO_EINTS];
 };
 
 #define	A10_GPIO_LOCK(_sc)		mtx_lock(&_sc->sc_mtx)
@@ -100,6 +111,8 @@ struct a10_gpio_softc {
 #define	A10_GPIO_GP_INT_CFG2		0x208
 #define	A10_GPIO_GP_INT_CFG3		0x20c
 
+#define	A10_GPIO_GP_INT_CFG(_eint)	(0x200 + ((_eint) >> 3) * 4)
+
 #define	A10_GPIO_GP_INT_CTL		0x210
 #define	A10_GPIO_GP_INT_STA		0x214
 #define	A10_GPIO_GP_INT_DEB		0x218
@@ -407,6 +420,62 @@ a10_gpio_pin_toggle(device_t dev, uint32_t pin)
 	return (0);
 }
 
+static int
+a10_gpio_pin_eint(uint32_t pin)
+{
+
+	if (pin >= 7 * 32 && pin <= 7 * 32 + 21)
+		return (pin - 7 * 32);
+	if (pin >= 8 * 32 + 10 && pin <= 8 * 32 + 19)
+		return (pin - (8 * 32 + 10) + 22);
+	return (-1);
+}
+
+static void
+a10_gpio_intr(void *arg)
+{
+	struct a10_gpio_softc *sc;
+	void (*handler)(void *);
+	void *harg;
+	uint32_t ctl, sta;
+	int i;
+
+	sc = (struct a10_gpio_softc *)arg;
+
+	/*
+	 * Each source stays masked until its consumer has quieted the
+	 * device behind it and calls a10_gpio_eint_unmask(), so a level
+	 * triggered line does not keep firing meanwhile.
+	 */
+	A10_GPIO_LOCK(sc);
+	ctl = A10_GPIO_READ(sc, A10_GPIO_GP_INT_CTL);
+	sta = A10_GPIO_READ(sc, A10_GPIO_GP_INT_STA) & ctl;
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CTL, ctl & ~sta);
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_STA, sta);
+	A10_GPIO_UNLOCK(sc);
+
+	for (i = 0; i < A10_GPIO_EINTS; i++) {
+		if ((sta & (1 << i)) == 0)
+			continue;
+		A10_GPIO_LOCK(sc);
+		handler = sc->sc_eint[i].ei_handler;
+		harg = sc->sc_eint[i].ei_arg;
+		if (handler != NULL)
+			sc->sc_eint[i].ei_running++;
+		A10_GPIO_UNLOCK(sc);
+		if (handler == NULL)
+			continue;
+
+		handler(harg);
+
+		/* Let a10_gpio_eint_teardown() know it has returned. */
+		A10_GPIO_LOCK(sc);
+		if (--sc->sc_eint[i].ei_running == 0)
+			wakeup(&sc->sc_eint[i]);
+		A10_GPIO_UNLOCK(sc);
+	}
+}
+
 static int
 a10_gpio_probe(device_t dev)
 {
@@ -452,6 +521,15 @@ a10_gpio_attach(device_t dev)
 		goto fail;
 	}
 
+	/* Quiesce the external interrupts, they are enabled on demand. */
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CTL, 0);
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_STA, 0xffffffff);
+	if (bus_setup_intr(dev, sc->sc_irq_res, INTR_TYPE_MISC | INTR_MPSAFE,
+	    NULL, a10_gpio_intr, sc, &sc->sc_intrhand) != 0) {
+		device_printf(dev, "cannot setup interrupt handler\n");
+		goto fail;
+	}
+
 	/* Find our node. */
 	gpio = ofw_bus_get_node(sc->sc_dev);
 
@@ -477,6 +555,8 @@ a10_gpio_attach(device_t dev)
 	return (0);
 
 fail:
+	if (sc->sc_intrhand)
+		bus_teardown_intr(dev, sc->sc_irq_res, sc->sc_intrhand);
 	if (sc->sc_irq_res)
 		bus_release_resource(dev, SYS_RES_IRQ, 0, sc->sc_irq_res);
 	if (sc->sc_mem_res)
@@ -538,3 +618,91 @@ a10_emac_gpio_config(uint32_t pin)
 
 	return (0);
 }
+
+/*
+ * Route an external interrupt pin to a handler.  The handler runs in
+ * the interrupt thread with the source masked; the caller unmasks it
+ * with a10_gpio_eint_unmask() once done.
+ */
+int
+a10_gpio_eint_setup(uint32_t pin, uint32_t mode, void (*handler)(void *),
+    void *arg)
+{
+	struct a10_gpio_softc *sc = a10_gpio_sc;
+	uint32_t offset, val;
+	int eint;
+
+	if (sc == NULL)
+		return (ENXIO);
+
+	eint = a10_gpio_pin_eint(pin);
+	if (eint < 0 || mode > A10_GPIO_EINT_DOUBLE_EDGE || handler == NULL)
+		return (EINVAL);
+
+	A10_GPIO_LOCK(sc);
+	if (sc->sc_eint[eint].ei_handler != NULL) {
+		A10_GPIO_UNLOCK(sc);
+		return (EBUSY);
+	}
+	sc->sc_eint[eint].ei_handler = handler;
+	sc->sc_eint[eint].ei_arg = arg;
+
+	a10_gpio_set_function(sc, pin, A10_GPIO_EINT_FUNC);
+	offset = (eint & 0x07) << 2;
+	val = A10_GPIO_READ(sc, A10_GPIO_GP_INT_CFG(eint));
+	val &= ~(0xf << offset);
+	val |= mode << offset;
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CFG(eint), val);
+
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_STA, 1 << eint);
+	val = A10_GPIO_READ(sc, A10_GPIO_GP_INT_CTL);
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CTL, val | (1 << eint));
+	A10_GPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+/*
+ * Mask the pin and detach its handler.  Returns once a handler already
+ * running has finished, so it must not be called from the handler.
+ */
+void
+a10_gpio_eint_teardown(uint32_t pin)
+{
+	struct a10_gpio_softc *sc = a10_gpio_sc;
+	uint32_t val;
+	int eint;
+
+	eint = a10_gpio_pin_eint(pin);
+	if (sc == NULL || eint < 0)
+		return;
+
+	A10_GPIO_LOCK(sc);
+	val = A10_GPIO_READ(sc, A10_GPIO_GP_INT_CTL);
+	A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CTL, val & ~(1 << eint));
+	sc->sc_eint[eint].ei_handler = NULL;
+	sc->sc_eint[eint].ei_arg = NULL;
+	/* Wait for a handler the interrupt thread already picked up. */
+	while (sc->sc_eint[eint].ei_running != 0)
+		mtx_sleep(&sc->sc_eint[eint], &sc->sc_mtx, 0, "gpioei", 0);
+	A10_GPIO_UNLOCK(sc);
+}
+
+void
+a10_gpio_eint_unmask(uint32_t pin)
+{
+	struct a10_gpio_softc *sc = a10_gpio_sc;
+	uint32_t val;
+	int eint;
+
+	eint = a10_gpio_pin_eint(pin);
+	if (sc == NULL || eint < 0)
+		return;
+
+	A10_GPIO_LOCK(sc);
+	if (sc->sc_eint[eint].ei_handler != NULL) {
+		val = A10_GPIO_READ(sc, A10_GPIO_GP_INT_CTL);
+		A10_GPIO_WRITE(sc, A10_GPIO_GP_INT_CTL, val | (1 << eint));
+	}
+	A10_GPIO_UNLOCK(sc);
+}
@@ -29,6 +29,17 @@
 #ifndef	_A10_GPIO_H_
 #define	_A10_GPIO_H_
 
+/* External interrupt trigger modes */
+#define	A10_GPIO_EINT_POS_EDGE		0
+#define	A10_GPIO_EINT_NEG_EDGE		1
+#define	A10_GPIO_EINT_HIGH_LEVEL	2
+#define	A10_GPIO_EINT_LOW_LEVEL		3
+#define	A10_GPIO_EINT_DOUBLE_EDGE	4
+
 int a10_emac_gpio_config(uint32_t pin);
+int a10_gpio_eint_setup(uint32_t pin, uint32_t mode, void (*handler)(void *),
+    void *arg);
+void a10_gpio_eint_teardown(uint32_t pin);
+void a10_gpio_eint_unmask(uint32_t pin);
 
 #endif
@@ -31,18 +31,30 @@
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD: head/sys/arm/allwinner/if_emac.c 271859 2014-09-19 09:20:16Z glebius $");
 
+#ifdef HAVE_KERNEL_OPTION_HEADERS
+#include "opt_device_polling.h"
+#include "opt_inet.h"
+#include "opt_inet6.h"
+#endif
+
 #include <sys/param.h>
 #include <sys/systm.h>
+#include <sys/buf_ring.h>
 #include <sys/kernel.h>
 #include <sys/module.h>
 #include <sys/bus.h>
+#include <sys/endian.h>
 #include <sys/lock.h>
+#include <sys/malloc.h>
 #include <sys/mbuf.h>
 #include <sys/mutex.h>
 #include <sys/rman.h>
+#include <sys/smp.h>
 #include <sys/socket.h>
 #include <sys/sockio.h>
+#include <sys/sx.h>
 #include <sys/sysctl.h>
+#include <sys/taskqueue.h>
 #include <sys/gpio.h>
 
 #include <machine/bus.h>
@@ -59,11 +71,15 @@ __FBSDID("$FreeBSD: head/sys/arm/allwinner/if_emac.c 271859 2014-09-19 09:20:16Z
 #include <net/ethernet.h>
 #include <net/if_vlan_var.h>
 
-#ifdef INET
+#if defined(INET) || defined(INET6)
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/in_var.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_lro.h>
+#include <machine/in_cksum.h>
 #endif
 
 #include <net/bpf.h>
@@ -77,15 +93,28 @@ __FBSDID("$FreeBSD: head/sys/arm/allwinner/if_emac.c 271859 2014-09-19 09:20:16Z
 #include <dev/mii/miivar.h>
 
 #include <arm/allwinner/if_emacreg.h>
+#include <arm/allwinner/if_emacvar.h>
 
 #include "miibus_if.h"
 
 #include "gpio_if.h"
 
 #include "a10_clk.h"
+#include "a10_dmac.h"
 #include "a10_sramc.h"
 #include "a10_gpio.h"
 
+struct emac_rx_cache {
+	struct mbuf		*rc_m[EMAC_RX_CACHE_SIZE];
+	int			rc_cnt;
+	int			rc_cluster;
+};
+
+struct emac_txfifo {
+	uint32_t		tf_carry;
+	int			tf_shift;
+};
+
 struct emac_softc {
 	struct ifnet		*emac_ifp;
 	device_t		emac_dev;
@@ -96,11 +125,115 @@ struct emac_softc {
 	struct resource		*emac_irq;
 	void			*emac_intrhand;
 	int			emac_if_flags;
-	struct mtx		emac_mtx;
+	struct mtx		emac_rx_mtx;
+	struct mtx		emac_tx_mtx;
+	struct buf_ring		*emac_br;
+	struct taskqueue	*emac_tq;
+	struct task		emac_tx_task;
+	struct task		emac_int_task;
+	uint32_t		emac_intr_status;
+	/* Interrupt moderation statistics */
+	u_long			emac_stat_intrs;
+	u_long			emac_stat_holdoffs;
+	u_long			emac_stat_rx_frames;
 	struct callout		emac_tick_ch;
+	/* PHY management, off the datapath locks */
+	struct sx		emac_mii_lock;
+	struct task		emac_mii_task;
+	u_int			emac_mii_mediachg;
+	u_int			emac_mii_intr;
+	int			emac_mii_ticks;
+	/* PHY interrupt on a GPIO pin, from FDT */
+	int			emac_phy_int_pin;
+	int			emac_phy_int_enreg;
+	int			emac_phy_int_enval;
+	int			emac_phy_int_ack;
+	u_long			emac_stat_phy_intrs;
+	struct callout		emac_holdoff_ch;
+	int			emac_holdoff_us;
+	int			emac_holdoff_frames;
 	int			emac_watchdog_timer;
 	int			emac_rx_process_limit;
 	int			emac_link;
+	uint32_t		emac_fifo_mask;
+	/* DRQ receive path */
+	struct a10_dmac_channel	*emac_rx_dma;
+	bus_dma_tag_t		emac_rx_tag;
+	bus_dmamap_t		emac_rx_map;
+	bus_addr_t		emac_rx_fifo_pa;
+	struct mbuf		*emac_rx_dma_m;
+	struct mbuf		*emac_rx_dma_mdone;
+	int			emac_rx_dma_len;
+	/* Receive mbufs, refilled once per batch */
+	struct emac_rx_cache	emac_rx_clcache;
+	struct emac_rx_cache	emac_rx_mcache;
+	u_long			emac_stat_rx_small;
+	u_long			emac_stat_rx_cluster;
+	/* Page shared by bursts of small frames */
+	struct mbuf		*emac_rx_pg;
+	int			emac_rx_pg_off;
+	int			emac_rx_pack_max;
+	u_long			emac_stat_rx_packed;
+	u_long			emac_stat_rx_pages;
+	u_long			emac_stat_rx_cache_empty;
+	u_long			emac_stat_rx_refill_fail;
+	u_long			emac_stat_rx_nombuf;
+	/* Receive flow control */
+	int			emac_fc_hiwat;
+	int			emac_fc_lowat;
+	int			emac_fc_on;
+	u_long			emac_fc_fails;
+	u_long			emac_stat_pause_tx;
+	u_long			emac_stat_pause_rx;
+	/* DRQ transmit path */
+	struct a10_dmac_channel	*emac_tx_dma;
+	bus_dma_tag_t		emac_tx_tag;
+	bus_dmamap_t		emac_tx_map;
+	bus_addr_t		emac_tx_fifo_pa;
+	struct mbuf		*emac_tx_dma_m;
+	bus_dma_segment_t	emac_tx_segs[EMAC_TXDMA_NSEGS + 1];
+	int			emac_tx_nsegs;
+	int			emac_tx_seg;
+	int			emac_tx_off;
+	bus_dma_tag_t		emac_tx_btag;
+	bus_dmamap_t		emac_tx_bmap;
+	uint8_t			*emac_tx_bounce;
+	bus_addr_t		emac_tx_bounce_pa;
+	uint32_t		emac_tx_dma_fifo;
+	/* TSO super-segment being cut into frames */
+	struct mbuf		*emac_tso_m;
+	uint32_t		emac_tso_hdr[howmany(ETHER_ALIGN +
+				    EMAC_TSO_HDR_MAX, 4)];
+	int			emac_tso_hlen;
+	int			emac_tso_l4off;
+	int			emac_tso_off;
+	int			emac_tso_mss;
+	int			emac_tso_seg;
+	int			emac_tso_ipv6;
+	uint32_t		emac_tso_seq;
+	uint16_t		emac_tso_id;
+	uint8_t			emac_tso_flags;
+	u_long			emac_stat_tso;
+	u_long			emac_stat_tso_segs;
+	/* Early receive classifier */
+	struct emac_cls_rule	emac_cls_rules[EMAC_CLS_MAXRULES];
+	int			emac_cls_nrules;
+	struct bpf_insn		*emac_cls_prog;
+	u_long			emac_stat_cls_drops;
+	/* Source address filter, in software past EMAC_SAF_SLOTS */
+	int			emac_saf_mode;
+	int			emac_saf_count;
+	uint8_t			emac_saf_addr[EMAC_SAF_MAXADDRS]
+				    [ETHER_ADDR_LEN];
+	u_long			emac_stat_saf_drops;
+	/* Monitor mode capture */
+	uint32_t		emac_mon_buf[howmany(ETHER_ALIGN +
+				    EMAC_MAC_MFL, 4)];
+	u_long			emac_stat_rx_monitor;
+#if defined(INET) || defined(INET6)
+	/* Only touched by the interrupt task */
+	struct lro_ctrl		emac_lro;
+#endif
 };
 
 static int	emac_probe(device_t);
@@ -114,15 +247,71 @@ static void	emac_sys_setup(void);
 static void	emac_reset(struct emac_softc *);
 
 static void	emac_init_locked(struct emac_softc *);
-static void	emac_start_locked(struct ifnet *);
+static int	emac_transmit(struct ifnet *, struct mbuf *);
+static void	emac_qflush(struct ifnet *);
+static void	emac_start_locked(struct emac_softc *);
+static __inline int emac_tx_pending(struct emac_softc *);
+static void	emac_txfifo_put(struct emac_softc *, struct emac_txfifo *,
+	    const uint8_t *, int);
+static void	emac_txfifo_copy(struct emac_softc *, struct emac_txfifo *,
+	    struct mbuf *, int, int);
+static void	emac_txfifo_flush(struct emac_softc *, struct emac_txfifo *);
+static void	emac_txfifo_write(struct emac_softc *, struct mbuf *);
+static void	emac_txfifo_send(struct emac_softc *, uint32_t, int);
+#if defined(INET) || defined(INET6)
+static void	emac_txcsum(struct mbuf *);
+static int	emac_tso_start(struct emac_softc *, struct mbuf *);
+static int	emac_tso_next(struct emac_softc *);
+#endif
+static void	emac_tx_task(void *, int);
 static void	emac_init(void *);
 static void	emac_stop_locked(struct emac_softc *);
-static void	emac_intr(void *);
+static int	emac_intr(void *);
+static void	emac_int_task(void *, int);
+static void	emac_holdoff(void *);
+static void	emac_rxinput(struct emac_softc *, struct mbuf *);
+#ifdef DEVICE_POLLING
+static poll_handler_t emac_poll;
+#endif
 static int	emac_ioctl(struct ifnet *, u_long, caddr_t);
 
-static void	emac_rxeof(struct emac_softc *, int);
-static void	emac_txeof(struct emac_softc *);
-
+static int	emac_rxhdr(struct emac_softc *, uint32_t *, int *);
+static struct mbuf *emac_rxeof(struct emac_softc *, int);
+static struct mbuf *emac_rxframe(struct emac_softc *, struct mbuf *, int);
+static uint64_t	emac_rxfifo_read(struct emac_softc *, uint8_t *, int,
+	    const uint32_t *, int);
+static void	emac_rxmonitor(struct emac_softc *, int, const uint32_t *,
+	    int);
+static int	emac_classify(struct emac_softc *, const uint8_t *, u_int,
+	    u_int);
+static int	emac_cls_progok(const struct bpf_insn *, u_int);
+static int	emac_drvspec(struct emac_softc *, u_long, struct ifdrv *);
+#if defined(INET) || defined(INET6)
+static void	emac_rxcsum(struct mbuf *, uint64_t);
+#endif
+static void	emac_rxdiscard(struct emac_softc *, int);
+static void	emac_rx_flowctl(struct emac_softc *, uint32_t);
+static struct mbuf *emac_rx_mget(struct emac_softc *, struct emac_rx_cache *);
+static struct mbuf *emac_rx_packget(struct emac_softc *, int);
+static void	emac_rx_cache_fill(struct emac_softc *);
+static void	emac_rx_cache_free(struct emac_softc *);
+static int	emac_rxdma_attach(struct emac_softc *);
+static void	emac_rxdma_detach(struct emac_softc *);
+static int	emac_rxdma_start(struct emac_softc *, struct mbuf *, int,
+	    const uint32_t *, int);
+static void	emac_rxdma_stop(struct emac_softc *);
+static void	emac_rxdma_done(void *);
+static int	emac_txdma_attach(struct emac_softc *);
+static void	emac_txdma_detach(struct emac_softc *);
+static int	emac_txdma_start(struct emac_softc *, struct mbuf *, uint32_t);
+static void	emac_txdma_stop(struct emac_softc *);
+static void	emac_txdma_done(void *);
+static void	emac_txeof(struct emac_softc *, uint32_t);
+
+static void	emac_mii_task(void *, int);
+static void	emac_phy_intr(void *);
+static void	emac_phy_intr_attach(struct emac_softc *);
+static void	emac_phy_intr_enable(struct emac_softc *);
 static int	emac_miibus_readreg(device_t, int, int);
 static int	emac_miibus_writereg(device_t, int, int, int);
 static void	emac_miibus_statchg(device_t);
@@ -132,12 +321,27 @@ static void	emac_ifmedia_sts(struct ifnet *, struct ifmediareq *);
 
 static int	sysctl_int_range(SYSCTL_HANDLER_ARGS, int, int);
 static int	sysctl_hw_emac_proc_limit(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_holdoff_us(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_holdoff_frames(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_coalesce(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_rx_pack_max(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_fc_hiwat(SYSCTL_HANDLER_ARGS);
+static int	sysctl_hw_emac_fc_lowat(SYSCTL_HANDLER_ARGS);
+static void	emac_add_sysctls(struct emac_softc *);
 
 #define	EMAC_READ_REG(sc, reg)		\
     bus_space_read_4(sc->emac_tag, sc->emac_handle, reg)
 #define	EMAC_WRITE_REG(sc, reg, val)	\
     bus_space_write_4(sc->emac_tag, sc->emac_handle, reg, val)
 
+/* Source address list too long for the MAC, checked by emac_classify() */
+#define	EMAC_SAF_SOFT(sc)	((sc)->emac_saf_mode != EMAC_SAF_OFF && \
+    (sc)->emac_saf_count > EMAC_SAF_SLOTS)
+
+#ifdef DEV_NETMAP
+#include <arm/allwinner/if_emac_netmap.h>
+#endif
+
 static void
 emac_sys_setup(void)
 {
@@ -197,13 +401,35 @@ emac_set_rx_mode(struct emac_softc *sc)
 	struct ifmultiaddr *ifma;
 	uint32_t h, hashes[2];
 	uint32_t rcr = 0;
+	uint8_t *sa;
+	int i;
 
-	EMAC_ASSERT_LOCKED(sc);
+	EMAC_RX_ASSERT_LOCKED(sc);
 
 	ifp = sc->emac_ifp;
 
 	rcr = EMAC_READ_REG(sc, EMAC_RX_CTL);
 
+	/*
+	 * Source address filter.  The slots take an address the same way
+	 * as the station address registers, unused ones repeat the first
+	 * entry.  Longer lists are left to emac_classify().
+	 */
+	rcr &= ~(EMAC_RX_SAF | EMAC_RX_SAIF);
+	if (sc->emac_saf_mode != EMAC_SAF_OFF && sc->emac_saf_count > 0 &&
+	    sc->emac_saf_count <= EMAC_SAF_SLOTS) {
+		for (i = 0; i < EMAC_SAF_SLOTS; i++) {
+			sa = sc->emac_saf_addr[i < sc->emac_saf_count ? i : 0];
+			EMAC_WRITE_REG(sc, EMAC_SAFX_H0 + i * 8,
+			    sa[0] << 16 | sa[1] << 8 | sa[2]);
+			EMAC_WRITE_REG(sc, EMAC_SAFX_L0 + i * 8,
+			    sa[3] << 16 | sa[4] << 8 | sa[5]);
+		}
+		rcr |= EMAC_RX_SAF;
+		if (sc->emac_saf_mode == EMAC_SAF_DENY)
+			rcr |= EMAC_RX_SAIF;
+	}
+
 	/* Unicast packet and DA filtering */
 	rcr |= EMAC_RX_UCAD;
 	rcr |= EMAC_RX_DAF;
@@ -239,6 +465,12 @@ emac_set_rx_mode(struct emac_softc *sc)
 	else
 		rcr |= EMAC_RX_UCAD;
 
+	/* Let pause frames through to count them while doing flow control. */
+	if (sc->emac_fc_hiwat != 0)
+		rcr |= EMAC_RX_PCF;
+	else
+		rcr &= ~EMAC_RX_PCF;
+
 	EMAC_WRITE_REG(sc, EMAC_RX_CTL, rcr);
 }
 
@@ -253,381 +485,1986 @@ emac_reset(struct emac_softc *sc)
 }
 
 static void
-emac_txeof(struct emac_softc *sc)
+emac_txeof(struct emac_softc *sc, uint32_t status)
 {
 	struct ifnet *ifp;
 
-	EMAC_ASSERT_LOCKED(sc);
+	EMAC_TX_ASSERT_LOCKED(sc);
 
 	ifp = sc->emac_ifp;
-	if_inc_counter(ifp, IFCOUNTER_OPACKETS, 1);
+	/* Only account for channels we actually filled. */
+	status &= sc->emac_fifo_mask;
+	sc->emac_fifo_mask &= ~status;
+	if (status == EMAC_TX_FIFO_ALL)
+		if_inc_counter(ifp, IFCOUNTER_OPACKETS, 2);
+	else if (status != 0)
+		if_inc_counter(ifp, IFCOUNTER_OPACKETS, 1);
 	ifp->if_drv_flags &= ~IFF_DRV_OACTIVE;
 
 	/* Unarm watchdog timer if no TX */
-	sc->emac_watchdog_timer = 0;
+	if (sc->emac_fifo_mask == 0)
+		sc->emac_watchdog_timer = 0;
 }
 
-static void
-emac_rxeof(struct emac_softc *sc, int count)
+/*
+ * Pull the next frame header out of the receive FIFO.  On success the
+ * payload, still in the FIFO, is *lenp bytes long without the CRC and
+ * *rxcount tells how many frames were pending.  EINVAL reports a bad
+ * frame, already skipped; any other error means there is nothing to
+ * read right now.
+ */
+static int
+emac_rxhdr(struct emac_softc *sc, uint32_t *rxcount, int *lenp)
 {
 	struct ifnet *ifp;
-	struct mbuf *m, *m0;
-	uint32_t reg_val, rxcount;
+	uint32_t reg_val;
 	int16_t len;
 	uint16_t status;
-	int good_packet, i;
+	int i;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
 
 	ifp = sc->emac_ifp;
-	for (; count > 0 &&
-	    (ifp->if_drv_flags & IFF_DRV_RUNNING) != 0; count--) {
-		/*
-		 * Race warning: The first packet might arrive with
-		 * the interrupts disabled, but the second will fix
-		 */
-		rxcount = EMAC_READ_REG(sc, EMAC_RX_FBC);
-		if (!rxcount) {
-			/* Had one stuck? */
-			rxcount = EMAC_READ_REG(sc, EMAC_RX_FBC);
-			if (!rxcount)
-				return;
-		}
-		/* Check packet header */
-		reg_val = EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
-		if (reg_val != EMAC_PACKET_HEADER) {
-			/* Packet header is wrong */
-			if (bootverbose)
-				if_printf(ifp, "wrong packet header\n");
-			/* Disable RX */
-			reg_val = EMAC_READ_REG(sc, EMAC_CTL);
-			reg_val &= ~EMAC_CTL_RX_EN;
-			EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
-
-			/* Flush RX FIFO */
-			reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
-			reg_val |= EMAC_RX_FLUSH_FIFO;
-			EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
-			for (i = 100; i > 0; i--) {
-				DELAY(100);
-				if ((EMAC_READ_REG(sc, EMAC_RX_CTL) &
-				    EMAC_RX_FLUSH_FIFO) == 0)
-					break;
-			}
-			if (i == 0) {
-				device_printf(sc->emac_dev,
-				    "flush FIFO timeout\n");
-				/* Reinitialize controller */
-				emac_init_locked(sc);
-				return;
-			}
-			/* Enable RX */
-			reg_val = EMAC_READ_REG(sc, EMAC_CTL);
-			reg_val |= EMAC_CTL_RX_EN;
-			EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
 
-			return;
+	/*
+	 * Race warning: The first packet might arrive with
+	 * the interrupts disabled, but the second will fix
+	 */
+	*rxcount = EMAC_READ_REG(sc, EMAC_RX_FBC);
+	if (!*rxcount) {
+		/* Had one stuck? */
+		*rxcount = EMAC_READ_REG(sc, EMAC_RX_FBC);
+		if (!*rxcount)
+			return (ENOENT);
+	}
+	/* Check packet header */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+	if (reg_val != EMAC_PACKET_HEADER) {
+		/* Packet header is wrong */
+		if (bootverbose)
+			if_printf(ifp, "wrong packet header\n");
+		/* Disable RX */
+		reg_val = EMAC_READ_REG(sc, EMAC_CTL);
+		reg_val &= ~EMAC_CTL_RX_EN;
+		EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
+
+		/* Flush RX FIFO */
+		reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+		reg_val |= EMAC_RX_FLUSH_FIFO;
+		EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+		for (i = 100; i > 0; i--) {
+			DELAY(100);
+			if ((EMAC_READ_REG(sc, EMAC_RX_CTL) &
+			    EMAC_RX_FLUSH_FIFO) == 0)
+				break;
 		}
+		if (i == 0) {
+			device_printf(sc->emac_dev,
+			    "flush FIFO timeout\n");
+			/* Reinitialize controller */
+			EMAC_TX_LOCK(sc);
+			emac_stop_locked(sc);
+			emac_init_locked(sc);
+			EMAC_TX_UNLOCK(sc);
+			return (EIO);
+		}
+		/* Enable RX */
+		reg_val = EMAC_READ_REG(sc, EMAC_CTL);
+		reg_val |= EMAC_CTL_RX_EN;
+		EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
 
-		good_packet = 1;
+		return (EIO);
+	}
 
-		/* Get packet size and status */
-		reg_val = EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
-		len = reg_val & 0xffff;
-		status = (reg_val >> 16) & 0xffff;
+	/* Get packet size and status */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+	len = reg_val & 0xffff;
+	status = (reg_val >> 16) & 0xffff;
 
-		if (len < 64) {
-			good_packet = 0;
-			if (bootverbose)
-				if_printf(ifp,
-				    "bad packet: len = %i status = %i\n",
-				    len, status);
-			if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
-		}
+	if (len < 64 || len > EMAC_MAC_MFL) {
+		if (bootverbose)
+			if_printf(ifp,
+			    "bad packet: len = %i status = %i\n",
+			    len, status);
+		if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
+		/*
+		 * Skip the payload so the next read lands on a header
+		 * instead of forcing a FIFO flush.
+		 */
+		if (len > ETHER_CRC_LEN)
+			emac_rxdiscard(sc, len - ETHER_CRC_LEN);
+		return (EINVAL);
+	}
 #if 0
-		if (status & (EMAC_CRCERR | EMAC_LENERR)) {
-			good_packet = 0;
-			if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
-			if (status & EMAC_CRCERR)
-				if_printf(ifp, "crc error\n");
-			if (status & EMAC_LENERR)
-				if_printf(ifp, "length error\n");
-		}
+	if (status & (EMAC_CRCERR | EMAC_LENERR)) {
+		if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
+		if (status & EMAC_CRCERR)
+			if_printf(ifp, "crc error\n");
+		if (status & EMAC_LENERR)
+			if_printf(ifp, "length error\n");
+		return (EINVAL);
+	}
 #endif
-		if (good_packet) {
-			m = m_getcl(M_NOWAIT, MT_DATA, M_PKTHDR);
-			if (m == NULL)
-				return;
-			m->m_len = m->m_pkthdr.len = MCLBYTES;
+	*lenp = len - ETHER_CRC_LEN;
+	return (0);
+}
+
+static struct mbuf *
+emac_rxeof(struct emac_softc *sc, int count)
+{
+	struct ifnet *ifp;
+	struct mbuf *m, *mh, **mt;
+	uint32_t rxcount;
+	uint64_t sum;
+	uint32_t head[EMAC_CLS_PEEK / 4];
+	int error, i, len, nhead, small;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	/*
+	 * Frames are collected on a local m_nextpkt list and passed to
+	 * the stack by the caller once the RX lock has been dropped.
+	 */
+	mh = NULL;
+	mt = &mh;
+
+	/* A DMA transfer is in flight, its completion resumes the drain. */
+	if (sc->emac_rx_dma_m != NULL)
+		return (mh);
+
+	/* Pick up the frame the last DMA transfer brought in. */
+	if (sc->emac_rx_dma_mdone != NULL) {
+		m = emac_rxframe(sc, sc->emac_rx_dma_mdone,
+		    sc->emac_rx_dma_len);
+		sc->emac_rx_dma_mdone = NULL;
+		if (m != NULL) {
+			*mt = m;
+			mt = &m->m_nextpkt;
+		}
+		count--;
+	}
 
-			len -= ETHER_CRC_LEN;
+	ifp = sc->emac_ifp;
+	for (; count > 0 &&
+	    (ifp->if_drv_flags & IFF_DRV_RUNNING) != 0; count--) {
+		error = emac_rxhdr(sc, &rxcount, &len);
+		if (error == EINVAL)
+			continue;
+		if (error != 0) {
+			if (error == ENOENT)
+				emac_rx_flowctl(sc, 0);
+			return (mh);
+		}
+		emac_rx_flowctl(sc, rxcount);
 
-			/* Copy entire frame to mbuf first. */
-			bus_space_read_multi_4(sc->emac_tag, sc->emac_handle,
-			    EMAC_RX_IO_DATA, mtod(m, uint32_t *),
-			    roundup2(len, 4) / 4);
+		/*
+		 * Look at the start of the frame before spending a
+		 * buffer on it, the words read stay in head[].
+		 */
+		nhead = 0;
+		if (sc->emac_cls_nrules != 0 || sc->emac_cls_prog != NULL ||
+		    EMAC_SAF_SOFT(sc)) {
+			nhead = min(roundup2(len, 4) / 4, nitems(head));
+			for (i = 0; i < nhead; i++)
+				head[i] = EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+			if (emac_classify(sc, (uint8_t *)head,
+			    min(len, nhead * 4), len) == EMAC_CLS_DROP) {
+				if_inc_counter(ifp, IFCOUNTER_IQDROPS, 1);
+				emac_rxdiscard(sc,
+				    roundup2(len, 4) - nhead * 4);
+				continue;
+			}
+		}
 
-			m->m_pkthdr.rcvif = ifp;
-			m->m_len = m->m_pkthdr.len = len;
+		/* Nothing but BPF gets to see it, so skip the mbuf. */
+		if ((ifp->if_flags & IFF_MONITOR) != 0) {
+			emac_rxmonitor(sc, len, head, nhead);
+			continue;
+		}
 
+		if (len <= sc->emac_rx_pack_max && rxcount > 1) {
+			/* More are queued, share a page with them. */
+			small = 1;
+			m = emac_rx_packget(sc, len);
+		} else {
 			/*
-			 * Emac controller needs strict aligment, so to avoid
-			 * copying over an entire frame to align, we allocate
-			 * a new mbuf and copy ethernet header + IP header to
-			 * the new mbuf. The new mbuf is prepended into the
-			 * existing mbuf chain.
+			 * The length is known before any payload is
+			 * read, so frames that fit go into a plain
+			 * mbuf and only the rest cost a cluster.
 			 */
-			if (m->m_len <= (MHLEN - ETHER_HDR_LEN)) {
-				bcopy(m->m_data, m->m_data + ETHER_HDR_LEN,
-				    m->m_len);
-				m->m_data += ETHER_HDR_LEN;
-			} else if (m->m_len <= (MCLBYTES - ETHER_HDR_LEN) &&
-			    m->m_len > (MHLEN - ETHER_HDR_LEN)) {
-				MGETHDR(m0, M_NOWAIT, MT_DATA);
-				if (m0 != NULL) {
-					len = ETHER_HDR_LEN +
-					    m->m_pkthdr.l2hlen;
-					bcopy(m->m_data, m0->m_data, len);
-					m->m_data += len;
-					m->m_len -= len;
-					m0->m_len = len;
-					M_MOVE_PKTHDR(m0, m);
-					m0->m_next = m;
-					m = m0;
+			small = (ETHER_ALIGN + roundup2(len, 4) <=
+			    MHLEN);
+			m = emac_rx_mget(sc, small ?
+			    &sc->emac_rx_mcache : &sc->emac_rx_clcache);
+			if (m != NULL) {
+				/*
+				 * Land the frame at ETHER_ALIGN so the
+				 * IP header ends up 32-bit aligned
+				 * without any later copy.
+				 */
+				m->m_data += ETHER_ALIGN;
+				if (small) {
+					sc->emac_stat_rx_small++;
+					m->m_len = MHLEN - ETHER_ALIGN;
 				} else {
-					if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
-					m_freem(m);
-					m = NULL;
-					continue;
+					sc->emac_stat_rx_cluster++;
+					m->m_len = MCLBYTES -
+					    ETHER_ALIGN;
 				}
-			} else if (m->m_len > EMAC_MAC_MAXF) {
-				if_inc_counter(ifp, IFCOUNTER_IERRORS, 1);
-				m_freem(m);
-				m = NULL;
-				continue;
+				m->m_pkthdr.len = m->m_len;
 			}
-			if_inc_counter(ifp, IFCOUNTER_IPACKETS, 1);
-			EMAC_UNLOCK(sc);
-			(*ifp->if_input)(ifp, m);
-			EMAC_LOCK(sc);
+		}
+		if (m == NULL) {
+			/* Drop it, but keep the FIFO moving. */
+			sc->emac_stat_rx_nombuf++;
+			if_inc_counter(ifp, IFCOUNTER_IQDROPS, 1);
+			emac_rxdiscard(sc,
+			    roundup2(len, 4) - nhead * 4);
+			continue;
+		}
+
+		/*
+		 * Let the DMA engine drain the FIFO if we can.  Not
+		 * worth the setup for what fits in a plain mbuf.
+		 */
+		if (!small && sc->emac_rx_dma != NULL &&
+		    emac_rxdma_start(sc, m, len, head, nhead) == 0)
+			return (mh);
+
+		sum = emac_rxfifo_read(sc, mtod(m, uint8_t *), len,
+		    head, nhead);
+
+		m = emac_rxframe(sc, m, len);
+		if (m != NULL) {
+#if defined(INET) || defined(INET6)
+			if ((ifp->if_capenable &
+			    (IFCAP_RXCSUM | IFCAP_RXCSUM_IPV6)) != 0)
+				emac_rxcsum(m, sum);
+#endif
+			*mt = m;
+			mt = &m->m_nextpkt;
 		}
 	}
+	return (mh);
 }
 
-static void
-emac_watchdog(struct emac_softc *sc)
+static struct mbuf *
+emac_rxframe(struct emac_softc *sc, struct mbuf *m, int len)
 {
 	struct ifnet *ifp;
 
-	EMAC_ASSERT_LOCKED(sc);
-
-	if (sc->emac_watchdog_timer == 0 || --sc->emac_watchdog_timer)
-		return;
+	EMAC_RX_ASSERT_LOCKED(sc);
 
 	ifp = sc->emac_ifp;
 
-	if (sc->emac_link == 0) {
-		if (bootverbose)
-			if_printf(sc->emac_ifp, "watchdog timeout "
-			    "(missed link)\n");
-	} else
-		if_printf(sc->emac_ifp, "watchdog timeout -- resetting\n");
-	
-	if_inc_counter(ifp, IFCOUNTER_OERRORS, 1);
-	ifp->if_drv_flags &= ~IFF_DRV_RUNNING;
-	emac_init_locked(sc);
-	if (!IFQ_DRV_IS_EMPTY(&ifp->if_snd))
-		emac_start_locked(ifp);
+	/* MAC control frames only come up to be counted. */
+	if (be16dec(mtod(m, uint8_t *) + 2 * ETHER_ADDR_LEN) ==
+	    ETHERTYPE_PAUSE) {
+		sc->emac_stat_pause_rx++;
+		m_freem(m);
+		return (NULL);
+	}
+
+	m->m_pkthdr.rcvif = ifp;
+	m->m_len = m->m_pkthdr.len = len;
+	if_inc_counter(ifp, IFCOUNTER_IPACKETS, 1);
+	return (m);
 }
 
-static void
-emac_tick(void *arg)
+/*
+ * Drain one frame from the receive FIFO into buf, which must sit
+ * ETHER_ALIGN bytes past a 32-bit boundary.  The FIFO only hands out
+ * whole words, so the first half word is stored on its own and every
+ * following store is assembled from two FIFO words.  Up to
+ * roundup2(len, 4) bytes are written.
+ *
+ * Since the words pass through the CPU anyway, they are also summed
+ * on the way; the unfolded sum covers all bytes written.  The first
+ * nhead words have already been taken out of the FIFO into head.
+ */
+static uint64_t
+emac_rxfifo_read(struct emac_softc *sc, uint8_t *buf, int len,
+    const uint32_t *head, int nhead)
 {
-	struct emac_softc *sc;
-	struct mii_data *mii;
-
-	sc = (struct emac_softc *)arg;
-	mii = device_get_softc(sc->emac_miibus);
-	mii_tick(mii);
+	uint64_t sum;
+	uint32_t *dst, carry, word;
+	int i, nwords;
 
-	emac_watchdog(sc);
-	callout_reset(&sc->emac_tick_ch, hz, emac_tick, sc);
-}
+	KASSERT(((uintptr_t)buf & 3) == ETHER_ALIGN,
+	    ("%s: misaligned buffer %p", __func__, buf));
 
-static void
-emac_init(void *xcs)
-{
-	struct emac_softc *sc;
+	nwords = roundup2(len, 4) / 4;
+	if (nwords == 0)
+		return (0);
+	word = (nhead > 0) ? head[0] : EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+	*(uint16_t *)buf = word & 0xffff;
+	sum = word;
+	carry = word >> 16;
+	dst = (uint32_t *)(buf + ETHER_ALIGN);
+	for (i = 1; i < nwords; i++) {
+		word = (i < nhead) ? head[i] :
+		    EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+		*dst++ = carry | (word << 16);
+		sum += word;
+		carry = word >> 16;
+	}
+	*(uint16_t *)dst = carry;
 
-	sc = (struct emac_softc *)xcs;
-	EMAC_LOCK(sc);
-	emac_init_locked(sc);
-	EMAC_UNLOCK(sc);
+	return (sum);
 }
 
+/*
+ * Monitor mode receive.  The stack would only tap the frame and free
+ * it, so it is copied from the FIFO into a scratch buffer and handed to
+ * BPF directly.  bpf_tap() takes the buffer length for the wire length,
+ * so the whole frame is read and the descriptors' own snaplen does the
+ * truncation.
+ */
 static void
-emac_init_locked(struct emac_softc *sc)
+emac_rxmonitor(struct emac_softc *sc, int len, const uint32_t *head,
+    int nhead)
 {
 	struct ifnet *ifp;
-	struct mii_data *mii;
-	uint32_t reg_val;
-	uint8_t *eaddr;
+	uint8_t *buf;
 
-	EMAC_ASSERT_LOCKED(sc);
+	EMAC_RX_ASSERT_LOCKED(sc);
 
 	ifp = sc->emac_ifp;
-	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) != 0)
+	sc->emac_stat_rx_monitor++;
+	if_inc_counter(ifp, IFCOUNTER_IPACKETS, 1);
+	if_inc_counter(ifp, IFCOUNTER_IBYTES, len);
+	if (!bpf_peers_present(ifp->if_bpf)) {
+		emac_rxdiscard(sc, roundup2(len, 4) - nhead * 4);
 		return;
+	}
 
-	/* Flush RX FIFO */
-	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
-	reg_val |= EMAC_RX_FLUSH_FIFO;
-	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
-	DELAY(1);
+	buf = (uint8_t *)sc->emac_mon_buf + ETHER_ALIGN;
+	(void)emac_rxfifo_read(sc, buf, len, head, nhead);
 
-	/* Soft reset MAC */
-	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL0);
-	reg_val &= (~EMAC_MAC_CTL0_SOFT_RST);
-	EMAC_WRITE_REG(sc, EMAC_MAC_CTL0, reg_val);
+	bpf_tap(ifp->if_bpf, buf, len);
+}
 
-	/* Set MII clock */
-	reg_val = EMAC_READ_REG(sc, EMAC_MAC_MCFG);
-	reg_val &= (~(0xf << 2));
-	reg_val |= (0xd << 2);
-	EMAC_WRITE_REG(sc, EMAC_MAC_MCFG, reg_val);
+#if defined(INET) || defined(INET6)
+static uint16_t
+emac_cksum_fold(uint64_t sum)
+{
 
-	/* Clear RX counter */
-	EMAC_WRITE_REG(sc, EMAC_RX_FBC, 0);
+	while (sum > 0xffff)
+		sum = (sum >> 16) + (sum & 0xffff);
+	return (sum);
+}
 
-	/* Disable all interrupt and clear interrupt status */
-	EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
-	reg_val = EMAC_READ_REG(sc, EMAC_INT_STA);
-	EMAC_WRITE_REG(sc, EMAC_INT_STA, reg_val);
-	DELAY(1);
+/* Sum of the 16-bit words in buf[off, end), off must be even. */
+static uint64_t
+emac_cksum_range(const uint8_t *buf, int off, int end)
+{
+	uint64_t sum;
+
+	sum = 0;
+	for (; off + 1 < end; off += 2)
+		sum += le16dec(buf + off);
+	if (off < end)
+		sum += buf[off];
+	return (sum);
+}
 
-	/* Set up TX */
-	reg_val = EMAC_READ_REG(sc, EMAC_TX_MODE);
-	reg_val |= EMAC_TX_AB_M;
-	reg_val &= EMAC_TX_TM;
-	EMAC_WRITE_REG(sc, EMAC_TX_MODE, reg_val);
+/*
+ * Turn the sum gathered by emac_rxfifo_read() into a TCP/UDP checksum
+ * verdict.  The bytes in front of and behind the transport segment are
+ * few and still in the cache, so they are summed again and taken out,
+ * and the pseudo header is added.  Only a checksum that verifies is
+ * reported; anything else is left to the stack.
+ */
+static void
+emac_rxcsum(struct mbuf *m, uint64_t sum)
+{
+	struct ether_header *eh;
+#ifdef INET
+	struct ip *ip;
+	int hlen;
+#endif
+#ifdef INET6
+	struct ip6_hdr *ip6;
+#endif
+	struct ifnet *ifp;
+	uint8_t *buf;
+	uint64_t part, pseudo;
+	int end, flags, l4end, l4off, len;
+	uint8_t proto;
+
+	ifp = m->m_pkthdr.rcvif;
+	buf = mtod(m, uint8_t *);
+	len = m->m_len;
+	end = roundup2(len, 4);
+	eh = (struct ether_header *)buf;
+
+	switch (ntohs(eh->ether_type)) {
+#ifdef INET
+	case ETHERTYPE_IP:
+		if ((ifp->if_capenable & IFCAP_RXCSUM) == 0 ||
+		    len < ETHER_HDR_LEN + sizeof(struct ip))
+			return;
+		ip = (struct ip *)(buf + ETHER_HDR_LEN);
+		hlen = ip->ip_hl << 2;
+		l4off = ETHER_HDR_LEN + hlen;
+		l4end = ETHER_HDR_LEN + ntohs(ip->ip_len);
+		if (ip->ip_v != IPVERSION || hlen < sizeof(struct ip) ||
+		    l4off > l4end || l4end > len)
+			return;
+		if (emac_cksum_fold(emac_cksum_range(buf, ETHER_HDR_LEN,
+		    l4off)) != 0xffff)
+			return;
+		m->m_pkthdr.csum_flags |= CSUM_IP_CHECKED | CSUM_IP_VALID;
+		if ((ntohs(ip->ip_off) & (IP_MF | IP_OFFMASK)) != 0)
+			return;
+		proto = ip->ip_p;
+		if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+			return;
+		pseudo = in_pseudo(ip->ip_src.s_addr, ip->ip_dst.s_addr,
+		    htonl(l4end - l4off + proto));
+		flags = CSUM_DATA_VALID | CSUM_PSEUDO_HDR;
+		break;
+#endif
+#ifdef INET6
+	case ETHERTYPE_IPV6:
+		if ((ifp->if_capenable & IFCAP_RXCSUM_IPV6) == 0 ||
+		    len < ETHER_HDR_LEN + sizeof(struct ip6_hdr))
+			return;
+		ip6 = (struct ip6_hdr *)(buf + ETHER_HDR_LEN);
+		proto = ip6->ip6_nxt;
+		if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+			return;
+		l4off = ETHER_HDR_LEN + sizeof(struct ip6_hdr);
+		l4end = l4off + ntohs(ip6->ip6_plen);
+		if (l4end > len)
+			return;
+		pseudo = in6_cksum_pseudo(ip6, l4end - l4off, proto, 0);
+		flags = CSUM_DATA_VALID_IPV6 | CSUM_PSEUDO_HDR;
+		break;
+#endif
+	default:
+		return;
+	}
 
-	/* Set up RX */
-	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
-	reg_val |= EMAC_RX_SETUP;
-	reg_val &= EMAC_RX_TM;
-	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+	/*
+	 * Take out everything outside [l4off, l4end).  An odd segment
+	 * ends in the middle of a word, whose first byte stays in.
+	 */
+	part = emac_cksum_range(buf, 0, l4off) +
+	    emac_cksum_range(buf, l4end & ~1, end);
+	if ((l4end & 1) != 0)
+		sum += buf[l4end - 1];
+	sum = emac_cksum_fold(sum) + (~emac_cksum_fold(part) & 0xffff) +
+	    pseudo;
+	if (emac_cksum_fold(sum) != 0xffff)
+		return;
 
-	/* Set up MAC CTL0. */
-	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL0);
-	reg_val |= EMAC_MAC_CTL0_SETUP;
-	EMAC_WRITE_REG(sc, EMAC_MAC_CTL0, reg_val);
+	m->m_pkthdr.csum_flags |= flags;
+	m->m_pkthdr.csum_data = 0xffff;
+}
+#endif
 
-	/* Set up MAC CTL1. */
-	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL1);
-	reg_val |= EMAC_MAC_CTL1_SETUP;
-	EMAC_WRITE_REG(sc, EMAC_MAC_CTL1, reg_val);
+/*
+ * Decide from the first caplen bytes of a frame whether it is worth a
+ * buffer at all.  Rules go first, the BPF program gets what is left.
+ */
+static int
+emac_classify(struct emac_softc *sc, const uint8_t *p, u_int caplen,
+    u_int wirelen)
+{
+	struct emac_cls_rule *r;
+	uint16_t type;
+	int i;
 
-	/* Set up IPGT */
-	EMAC_WRITE_REG(sc, EMAC_MAC_IPGT, EMAC_MAC_IPGT_FD);
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	if (EMAC_SAF_SOFT(sc)) {
+		for (i = 0; i < sc->emac_saf_count; i++)
+			if (bcmp(p + ETHER_ADDR_LEN, sc->emac_saf_addr[i],
+			    ETHER_ADDR_LEN) == 0)
+				break;
+		if ((i < sc->emac_saf_count) ==
+		    (sc->emac_saf_mode == EMAC_SAF_DENY)) {
+			sc->emac_stat_saf_drops++;
+			return (EMAC_CLS_DROP);
+		}
+	}
 
-	/* Set up IPGR */
-	EMAC_WRITE_REG(sc, EMAC_MAC_IPGR, EMAC_MAC_NBTB_IPG2 |
-	    (EMAC_MAC_NBTB_IPG1 << 8));
+	type = be16dec(p + 2 * ETHER_ADDR_LEN);
+	for (i = 0; i < sc->emac_cls_nrules; i++) {
+		r = &sc->emac_cls_rules[i];
+		if ((r->ecr_match & EMAC_CLS_MATCH_DST) != 0 &&
+		    bcmp(p, r->ecr_dst, ETHER_ADDR_LEN) != 0)
+			continue;
+		if ((r->ecr_match & EMAC_CLS_MATCH_BCAST) != 0 &&
+		    bcmp(p, sc->emac_ifp->if_broadcastaddr,
+		    ETHER_ADDR_LEN) != 0)
+			continue;
+		if ((r->ecr_match & EMAC_CLS_MATCH_MCAST) != 0 &&
+		    !ETHER_IS_MULTICAST(p))
+			continue;
+		if ((r->ecr_match & EMAC_CLS_MATCH_TYPE) != 0 &&
+		    type != r->ecr_type)
+			continue;
+		r->ecr_hits++;
+		if (r->ecr_action == EMAC_CLS_DROP)
+			sc->emac_stat_cls_drops++;
+		return (r->ecr_action);
+	}
+	if (sc->emac_cls_prog != NULL &&
+	    bpf_filter(sc->emac_cls_prog, __DECONST(u_char *, p), wirelen,
+	    caplen) == 0) {
+		sc->emac_stat_cls_drops++;
+		return (EMAC_CLS_DROP);
+	}
 
-	/* Set up Collison window */
-	EMAC_WRITE_REG(sc, EMAC_MAC_CLRT, EMAC_MAC_RM | (EMAC_MAC_CW << 8));
+	return (EMAC_CLS_PASS);
+}
 
-	/* Set up Max Frame Length */
-	EMAC_WRITE_REG(sc, EMAC_MAC_MAXF, EMAC_MAC_MFL);
+/*
+ * bpf_filter() turns a load past the bytes it was handed into a zero
+ * return, which the classifier takes as a drop.  Only accept programs
+ * whose loads stay within the EMAC_CLS_PEEK bytes they get to see;
+ * indirect loads cannot be checked up front and are refused.
+ */
+static int
+emac_cls_progok(const struct bpf_insn *prog, u_int n)
+{
+	const struct bpf_insn *p;
+	u_int size;
+
+	for (p = prog; p < prog + n; p++) {
+		if (BPF_CLASS(p->code) != BPF_LD &&
+		    BPF_CLASS(p->code) != BPF_LDX)
+			continue;
+		switch (BPF_MODE(p->code)) {
+		case BPF_ABS:
+		case BPF_MSH:
+			break;
+		case BPF_IND:
+			return (0);
+		default:
+			continue;
+		}
+		switch (BPF_SIZE(p->code)) {
+		case BPF_W:
+			size = 4;
+			break;
+		case BPF_H:
+			size = 2;
+			break;
+		default:
+			size = 1;
+			break;
+		}
+		if (p->k > EMAC_CLS_PEEK - size)
+			return (0);
+	}
 
-	/* Setup ethernet address */
-	eaddr = IF_LLADDR(ifp);
-	EMAC_WRITE_REG(sc, EMAC_MAC_A1, eaddr[0] << 16 |
-	    eaddr[1] << 8 | eaddr[2]);
-	EMAC_WRITE_REG(sc, EMAC_MAC_A0, eaddr[3] << 16 |
-	    eaddr[4] << 8 | eaddr[5]);
+	return (1);
+}
 
-	/* Setup rx filter */
-	emac_set_rx_mode(sc);
+static void
+emac_rxdiscard(struct emac_softc *sc, int len)
+{
+	int i;
 
-	/* Enable RX/TX0/RX Hlevel interrupt */
-	reg_val = EMAC_READ_REG(sc, EMAC_INT_CTL);
-	reg_val |= EMAC_INT_EN;
-	EMAC_WRITE_REG(sc, EMAC_INT_CTL, reg_val);
+	EMAC_RX_ASSERT_LOCKED(sc);
 
-	ifp->if_drv_flags |= IFF_DRV_RUNNING;
-	ifp->if_drv_flags &= ~IFF_DRV_OACTIVE;
+	for (i = roundup2(len, 4) / 4; i > 0; i--)
+		(void)EMAC_READ_REG(sc, EMAC_RX_IO_DATA);
+}
 
-	sc->emac_link = 0;
+/*
+ * Receive flow control.  Ask the link partner to hold off once the FIFO
+ * backs up past the high watermark or receive mbuf allocations start to
+ * fail, rather than let it overflow, and release once the FIFO is back
+ * down to the low watermark and allocations succeed again.  A drained
+ * cache alone does not count, the m_getcl() fallback covers it during
+ * a burst.  An empty FIFO always releases: nothing is left to hold off
+ * for, and waiting for the mbufs could keep the link paused.
+ *
+ * Only this, the fc_hiwat handler and emac_stop_locked() touch
+ * EMAC_TX_FLOW, all with the RX lock held, and the transmit side never
+ * does, so the TX lock is not needed around it.
+ */
+static void
+emac_rx_flowctl(struct emac_softc *sc, uint32_t pending)
+{
+	uint32_t reg_val;
+	u_long fails;
+	int busy;
 
-	/* Switch to the current media. */
-	mii = device_get_softc(sc->emac_miibus);
-	mii_mediachg(mii);
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	/* Any allocation failure since the last call? */
+	fails = sc->emac_stat_rx_refill_fail + sc->emac_stat_rx_nombuf;
+	busy = (fails != sc->emac_fc_fails);
+	sc->emac_fc_fails = fails;
+
+	if (sc->emac_fc_hiwat == 0)
+		return;
+
+	if (sc->emac_fc_on == 0) {
+		if (pending < sc->emac_fc_hiwat && !busy)
+			return;
+		sc->emac_fc_on = 1;
+		sc->emac_stat_pause_tx++;
+		reg_val = EMAC_READ_REG(sc, EMAC_TX_FLOW);
+		EMAC_WRITE_REG(sc, EMAC_TX_FLOW, reg_val | EMAC_TX_FLOW_EN);
+	} else {
+		if (pending > sc->emac_fc_lowat || (busy && pending != 0))
+			return;
+		sc->emac_fc_on = 0;
+		reg_val = EMAC_READ_REG(sc, EMAC_TX_FLOW);
+		EMAC_WRITE_REG(sc, EMAC_TX_FLOW, reg_val & ~EMAC_TX_FLOW_EN);
+	}
+}
+
+static struct mbuf *
+emac_rx_mget(struct emac_softc *sc, struct emac_rx_cache *rc)
+{
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	if (rc->rc_cnt > 0)
+		return (rc->rc_m[--rc->rc_cnt]);
+
+	/* Ran dry in the middle of a burst, ask UMA for this one. */
+	sc->emac_stat_rx_cache_empty++;
+	if (rc->rc_cluster)
+		return (m_getcl(M_NOWAIT, MT_DATA, M_PKTHDR));
+	return (m_gethdr(M_NOWAIT, MT_DATA));
+}
+
+/*
+ * Carve a slice for a small frame out of the current receive page.
+ * Every frame holds a reference on the page; the softc drops its own
+ * once the page is full, and the last frame freed by the stack
+ * releases it.
+ */
+static struct mbuf *
+emac_rx_packget(struct emac_softc *sc, int len)
+{
+	struct mbuf *m, *pg;
+	int size;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	/* Whole cache lines, so frames never share one. */
+	size = roundup2(ETHER_ALIGN + roundup2(len, 4), CACHE_LINE_SIZE);
+	if (sc->emac_rx_pg != NULL &&
+	    sc->emac_rx_pg_off + size > MJUMPAGESIZE) {
+		m_free(sc->emac_rx_pg);
+		sc->emac_rx_pg = NULL;
+	}
+	if (sc->emac_rx_pg == NULL) {
+		sc->emac_rx_pg = m_getjcl(M_NOWAIT, MT_DATA, 0, MJUMPAGESIZE);
+		if (sc->emac_rx_pg == NULL)
+			return (NULL);
+		sc->emac_rx_pg_off = 0;
+		sc->emac_stat_rx_pages++;
+	}
+
+	m = emac_rx_mget(sc, &sc->emac_rx_mcache);
+	if (m == NULL)
+		return (NULL);
+	pg = sc->emac_rx_pg;
+	mb_dupcl(m, pg);
+	m->m_data = pg->m_ext.ext_buf + sc->emac_rx_pg_off + ETHER_ALIGN;
+	m->m_len = m->m_pkthdr.len = size - ETHER_ALIGN;
+	sc->emac_rx_pg_off += size;
+	sc->emac_stat_rx_packed++;
+
+	return (m);
+}
+
+static void
+emac_rx_cache_fill(struct emac_softc *sc)
+{
+	struct emac_rx_cache *rc, *caches[2];
+	struct mbuf *m;
+	int i;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	caches[0] = &sc->emac_rx_clcache;
+	caches[1] = &sc->emac_rx_mcache;
+	for (i = 0; i < nitems(caches); i++) {
+		rc = caches[i];
+		while (rc->rc_cnt < EMAC_RX_CACHE_SIZE) {
+			if (rc->rc_cluster)
+				m = m_getcl(M_NOWAIT, MT_DATA, M_PKTHDR);
+			else
+				m = m_gethdr(M_NOWAIT, MT_DATA);
+			if (m == NULL) {
+				sc->emac_stat_rx_refill_fail++;
+				break;
+			}
+			rc->rc_m[rc->rc_cnt++] = m;
+		}
+	}
+}
+
+static void
+emac_rx_cache_free(struct emac_softc *sc)
+{
+	struct emac_rx_cache *rc;
+
+	rc = &sc->emac_rx_clcache;
+	while (rc->rc_cnt > 0)
+		m_freem(rc->rc_m[--rc->rc_cnt]);
+	rc = &sc->emac_rx_mcache;
+	while (rc->rc_cnt > 0)
+		m_freem(rc->rc_m[--rc->rc_cnt]);
+	if (sc->emac_rx_pg != NULL) {
+		m_free(sc->emac_rx_pg);
+		sc->emac_rx_pg = NULL;
+	}
+}
+
+static int
+emac_rxdma_attach(struct emac_softc *sc)
+{
+	int error;
+
+	sc->emac_rx_fifo_pa = rman_get_start(sc->emac_res) + EMAC_RX_IO_DATA;
+
+	error = bus_dma_tag_create(
+	    bus_get_dma_tag(sc->emac_dev),	/* Parent tag */
+	    ETHER_ALIGN, 0,			/* alignment, boundary */
+	    BUS_SPACE_MAXADDR_32BIT,		/* lowaddr */
+	    BUS_SPACE_MAXADDR,			/* highaddr */
+	    NULL, NULL,				/* filter, filterarg */
+	    MCLBYTES, 1,			/* maxsize, nsegments */
+	    MCLBYTES,				/* maxsegsize */
+	    0,					/* flags */
+	    NULL, NULL,				/* lockfunc, lockarg */
+	    &sc->emac_rx_tag);
+	if (error != 0)
+		return (error);
+
+	error = bus_dmamap_create(sc->emac_rx_tag, 0, &sc->emac_rx_map);
+	if (error != 0) {
+		bus_dma_tag_destroy(sc->emac_rx_tag);
+		sc->emac_rx_tag = NULL;
+		return (error);
+	}
+
+	sc->emac_rx_dma = a10_dmac_alloc(emac_rxdma_done, sc);
+	if (sc->emac_rx_dma == NULL) {
+		emac_rxdma_detach(sc);
+		return (ENXIO);
+	}
+
+	return (0);
+}
+
+static void
+emac_rxdma_detach(struct emac_softc *sc)
+{
+
+	if (sc->emac_rx_dma != NULL) {
+		a10_dmac_free(sc->emac_rx_dma);
+		sc->emac_rx_dma = NULL;
+	}
+	if (sc->emac_rx_map != NULL) {
+		bus_dmamap_destroy(sc->emac_rx_tag, sc->emac_rx_map);
+		sc->emac_rx_map = NULL;
+	}
+	if (sc->emac_rx_tag != NULL) {
+		bus_dma_tag_destroy(sc->emac_rx_tag);
+		sc->emac_rx_tag = NULL;
+	}
+}
+
+static int
+emac_rxdma_start(struct emac_softc *sc, struct mbuf *m, int len,
+    const uint32_t *head, int nhead)
+{
+	struct a10_dmac_config conf;
+	bus_dma_segment_t seg;
+	uint32_t reg_val;
+	int error, nsegs, skip;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	error = bus_dmamap_load_mbuf_sg(sc->emac_rx_tag, sc->emac_rx_map, m,
+	    &seg, &nsegs, BUS_DMA_NOWAIT);
+	if (error != 0)
+		return (error);
+
+	/*
+	 * Words already taken out of the FIFO are stored by the CPU and
+	 * written back before the transfer brings in the rest.
+	 */
+	skip = nhead * 4;
+	if (skip != 0)
+		bcopy(head, mtod(m, uint8_t *), skip);
+	bus_dmamap_sync(sc->emac_rx_tag, sc->emac_rx_map,
+	    BUS_DMASYNC_PREREAD | BUS_DMASYNC_PREWRITE);
+
+	/* Hand the FIFO over to the DRQ line for this frame. */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+	reg_val |= EMAC_RX_DMA | EMAC_RX_DRQ_MODE;
+	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+
+	conf.src_drq = A10_DDMA_DRQ_EMAC_RX;
+	conf.src_mode = A10_DDMA_ADDR_IO;
+	conf.src_width = A10_DMA_WIDTH_32;
+	conf.src_burst = A10_DMA_BURST_1;
+	conf.dst_drq = A10_DDMA_DRQ_SDRAM;
+	conf.dst_mode = A10_DDMA_ADDR_LINEAR;
+	/* The buffer starts at ETHER_ALIGN, store half words. */
+	conf.dst_width = A10_DMA_WIDTH_16;
+	conf.dst_burst = A10_DMA_BURST_4;
+
+	sc->emac_rx_dma_m = m;
+	sc->emac_rx_dma_len = len;
+	error = a10_dmac_transfer(sc->emac_rx_dma, &conf,
+	    sc->emac_rx_fifo_pa, seg.ds_addr + skip, roundup2(len, 4) - skip);
+	if (error != 0) {
+		sc->emac_rx_dma_m = NULL;
+		reg_val &= ~(EMAC_RX_DMA | EMAC_RX_DRQ_MODE);
+		EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+		bus_dmamap_unload(sc->emac_rx_tag, sc->emac_rx_map);
+	}
+
+	return (error);
+}
+
+static void
+emac_rxdma_stop(struct emac_softc *sc)
+{
+	uint32_t reg_val;
+
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	if (sc->emac_rx_dma_mdone != NULL) {
+		m_freem(sc->emac_rx_dma_mdone);
+		sc->emac_rx_dma_mdone = NULL;
+	}
+	if (sc->emac_rx_dma_m == NULL)
+		return;
+
+	a10_dmac_halt(sc->emac_rx_dma);
+	bus_dmamap_sync(sc->emac_rx_tag, sc->emac_rx_map,
+	    BUS_DMASYNC_POSTREAD);
+	bus_dmamap_unload(sc->emac_rx_tag, sc->emac_rx_map);
+	m_freem(sc->emac_rx_dma_m);
+	sc->emac_rx_dma_m = NULL;
+
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+	reg_val &= ~(EMAC_RX_DMA | EMAC_RX_DRQ_MODE);
+	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+}
+
+/*
+ * Called from the DMA controller's interrupt thread.  Only finish the
+ * transfer here; the frame goes up, and the FIFO drain resumes, from
+ * the interrupt task.
+ */
+static void
+emac_rxdma_done(void *arg)
+{
+	struct emac_softc *sc;
+	struct mbuf *m;
+	uint32_t reg_val;
+
+	sc = (struct emac_softc *)arg;
+	EMAC_RX_LOCK(sc);
+	m = sc->emac_rx_dma_m;
+	if (m == NULL) {
+		EMAC_RX_UNLOCK(sc);
+		return;
+	}
+	sc->emac_rx_dma_m = NULL;
+	bus_dmamap_sync(sc->emac_rx_tag, sc->emac_rx_map,
+	    BUS_DMASYNC_POSTREAD);
+	bus_dmamap_unload(sc->emac_rx_tag, sc->emac_rx_map);
 
+	/* Give the FIFO back to the CPU for the next packet header. */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+	reg_val &= ~(EMAC_RX_DMA | EMAC_RX_DRQ_MODE);
+	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+
+	sc->emac_rx_dma_mdone = m;
+	EMAC_RX_UNLOCK(sc);
+
+	atomic_set_32(&sc->emac_intr_status, EMAC_INT_STA_RX);
+	taskqueue_enqueue(sc->emac_tq, &sc->emac_int_task);
+}
+
+static void
+emac_watchdog(struct emac_softc *sc)
+{
+	struct ifnet *ifp;
+
+	EMAC_ASSERT_LOCKED(sc);
+
+	if (sc->emac_watchdog_timer == 0 || --sc->emac_watchdog_timer)
+		return;
+
+	ifp = sc->emac_ifp;
+
+	if (sc->emac_link == 0) {
+		if (bootverbose)
+			if_printf(sc->emac_ifp, "watchdog timeout "
+			    "(missed link)\n");
+	} else
+		if_printf(sc->emac_ifp, "watchdog timeout -- resetting\n");
+	
+	if_inc_counter(ifp, IFCOUNTER_OERRORS, 1);
+	/* Abort the stuck transfer before starting over. */
+	emac_stop_locked(sc);
+	emac_init_locked(sc);
+	if (emac_tx_pending(sc))
+		emac_start_locked(sc);
+}
+
+static void
+emac_tick(void *arg)
+{
+	struct emac_softc *sc;
+
+	sc = (struct emac_softc *)arg;
+	EMAC_RX_ASSERT_LOCKED(sc);
+
+	/* The callout holds the RX lock, the watchdog needs both. */
+	EMAC_TX_LOCK(sc);
+	emac_watchdog(sc);
+	EMAC_TX_UNLOCK(sc);
+
+	/*
+	 * Link monitoring talks to the PHY, leave it to a thread.  With
+	 * the PHY interrupt wired up this is just a safety net.
+	 */
+	if (sc->emac_phy_int_pin < 0 ||
+	    ++sc->emac_mii_ticks >= EMAC_MII_SLOW_TICKS) {
+		sc->emac_mii_ticks = 0;
+		taskqueue_enqueue(taskqueue_thread, &sc->emac_mii_task);
+	}
 	callout_reset(&sc->emac_tick_ch, hz, emac_tick, sc);
 }
 
-
+/*
+ * PHY housekeeping: a media change requested by init, a status update
+ * after a PHY interrupt, otherwise the periodic mii_tick().  Runs on the
+ * shared thread taskqueue holding only the MII lock, so a slow MDIO
+ * transfer never holds up the datapath.
+ */
+static void
+emac_mii_task(void *arg, int pending)
+{
+	struct emac_softc *sc;
+	struct mii_data *mii;
+	struct mii_softc *miisc;
+	int intr;
+
+	sc = (struct emac_softc *)arg;
+	EMAC_MII_LOCK(sc);
+	mii = device_get_softc(sc->emac_miibus);
+	intr = atomic_readandclear_int(&sc->emac_mii_intr);
+	if (intr != 0 && sc->emac_phy_int_ack >= 0)
+		LIST_FOREACH(miisc, &mii->mii_phys, mii_list)
+			(void)PHY_READ(miisc, sc->emac_phy_int_ack);
+	if ((sc->emac_ifp->if_drv_flags & IFF_DRV_RUNNING) != 0) {
+		if (atomic_readandclear_int(&sc->emac_mii_mediachg) != 0)
+			mii_mediachg(mii);
+		else if (intr != 0)
+			mii_pollstat(mii);
+		else
+			mii_tick(mii);
+	}
+	if (intr != 0)
+		a10_gpio_eint_unmask(sc->emac_phy_int_pin);
+	EMAC_MII_UNLOCK(sc);
+}
+
+/*
+ * Interrupt thread handler for the PHY interrupt pin, which stays masked
+ * until emac_mii_task() has acknowledged the PHY.
+ */
+static void
+emac_phy_intr(void *arg)
+{
+	struct emac_softc *sc;
+
+	sc = (struct emac_softc *)arg;
+	sc->emac_stat_phy_intrs++;
+	atomic_store_rel_int(&sc->emac_mii_intr, 1);
+	taskqueue_enqueue(taskqueue_thread, &sc->emac_mii_task);
+}
+
+/*
+ * Hook up the PHY interrupt output if the FDT node describes it:
+ *
+ *	phy-int-gpios = <&GPIO bank pin mode>;	A10_GPIO_EINT_* mode
+ *	phy-int-enable = <reg value>;		PHY write enabling it
+ *	phy-int-ack = <reg>;			PHY read acknowledging it
+ *
+ * The pin must be one of the external interrupt capable ones.
+ */
+static void
+emac_phy_intr_attach(struct emac_softc *sc)
+{
+	phandle_t node;
+	pcell_t gpio[4], reg[2];
+	uint32_t pin;
+
+	sc->emac_phy_int_enreg = -1;
+	sc->emac_phy_int_ack = -1;
+	node = ofw_bus_get_node(sc->emac_dev);
+	if (OF_getencprop(node, "phy-int-gpios", gpio, sizeof(gpio)) !=
+	    sizeof(gpio))
+		return;
+	if (OF_getencprop(node, "phy-int-enable", reg, sizeof(reg)) ==
+	    sizeof(reg)) {
+		sc->emac_phy_int_enreg = reg[0];
+		sc->emac_phy_int_enval = reg[1];
+	}
+	if (OF_getencprop(node, "phy-int-ack", reg, sizeof(reg[0])) ==
+	    sizeof(reg[0]))
+		sc->emac_phy_int_ack = reg[0];
+
+	pin = gpio[1] * 32 + gpio[2];
+	if (a10_gpio_eint_setup(pin, gpio[3], emac_phy_intr, sc) != 0) {
+		device_printf(sc->emac_dev,
+		    "cannot use pin %u for the PHY interrupt\n", pin);
+		return;
+	}
+	sc->emac_phy_int_pin = pin;
+
+	EMAC_MII_LOCK(sc);
+	emac_phy_intr_enable(sc);
+	EMAC_MII_UNLOCK(sc);
+}
+
+static void
+emac_phy_intr_enable(struct emac_softc *sc)
+{
+	struct mii_data *mii;
+	struct mii_softc *miisc;
+
+	EMAC_MII_ASSERT_LOCKED(sc);
+
+	if (sc->emac_phy_int_pin < 0 || sc->emac_phy_int_enreg < 0)
+		return;
+	mii = device_get_softc(sc->emac_miibus);
+	LIST_FOREACH(miisc, &mii->mii_phys, mii_list)
+		PHY_WRITE(miisc, sc->emac_phy_int_enreg,
+		    sc->emac_phy_int_enval);
+}
+
+static void
+emac_init(void *xcs)
+{
+	struct emac_softc *sc;
+
+	sc = (struct emac_softc *)xcs;
+	EMAC_LOCK(sc);
+	emac_init_locked(sc);
+	EMAC_UNLOCK(sc);
+}
+
+static void
+emac_init_locked(struct emac_softc *sc)
+{
+	struct ifnet *ifp;
+	uint32_t reg_val;
+	uint8_t *eaddr;
+
+	EMAC_ASSERT_LOCKED(sc);
+
+	ifp = sc->emac_ifp;
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) != 0)
+		return;
+
+	/* Flush RX FIFO */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+	reg_val |= EMAC_RX_FLUSH_FIFO;
+	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+	DELAY(1);
+
+	/* Soft reset MAC */
+	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL0);
+	reg_val &= (~EMAC_MAC_CTL0_SOFT_RST);
+	EMAC_WRITE_REG(sc, EMAC_MAC_CTL0, reg_val);
+
+	/* Set MII clock */
+	reg_val = EMAC_READ_REG(sc, EMAC_MAC_MCFG);
+	reg_val &= (~(0xf << 2));
+	reg_val |= (0xd << 2);
+	EMAC_WRITE_REG(sc, EMAC_MAC_MCFG, reg_val);
+
+	/* Clear RX counter */
+	EMAC_WRITE_REG(sc, EMAC_RX_FBC, 0);
+
+	/* Disable all interrupt and clear interrupt status */
+	EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
+	reg_val = EMAC_READ_REG(sc, EMAC_INT_STA);
+	EMAC_WRITE_REG(sc, EMAC_INT_STA, reg_val);
+	DELAY(1);
+
+	/* Set up TX */
+	reg_val = EMAC_READ_REG(sc, EMAC_TX_MODE);
+	reg_val |= EMAC_TX_AB_M;
+	reg_val &= EMAC_TX_TM;
+	EMAC_WRITE_REG(sc, EMAC_TX_MODE, reg_val);
+
+	/* Set up RX */
+	reg_val = EMAC_READ_REG(sc, EMAC_RX_CTL);
+	reg_val |= EMAC_RX_SETUP;
+	reg_val &= EMAC_RX_TM;
+	EMAC_WRITE_REG(sc, EMAC_RX_CTL, reg_val);
+
+	/* Set up MAC CTL0. */
+	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL0);
+	reg_val |= EMAC_MAC_CTL0_SETUP;
+	EMAC_WRITE_REG(sc, EMAC_MAC_CTL0, reg_val);
+
+	/* Set up MAC CTL1. */
+	reg_val = EMAC_READ_REG(sc, EMAC_MAC_CTL1);
+	reg_val |= EMAC_MAC_CTL1_SETUP;
+	EMAC_WRITE_REG(sc, EMAC_MAC_CTL1, reg_val);
+
+	/* Set up IPGT */
+	EMAC_WRITE_REG(sc, EMAC_MAC_IPGT, EMAC_MAC_IPGT_FD);
+
+	/* Set up IPGR */
+	EMAC_WRITE_REG(sc, EMAC_MAC_IPGR, EMAC_MAC_NBTB_IPG2 |
+	    (EMAC_MAC_NBTB_IPG1 << 8));
+
+	/* Set up Collison window */
+	EMAC_WRITE_REG(sc, EMAC_MAC_CLRT, EMAC_MAC_RM | (EMAC_MAC_CW << 8));
+
+	/* Set up Max Frame Length */
+	EMAC_WRITE_REG(sc, EMAC_MAC_MAXF, EMAC_MAC_MFL);
+
+	/* Setup ethernet address */
+	eaddr = IF_LLADDR(ifp);
+	EMAC_WRITE_REG(sc, EMAC_MAC_A1, eaddr[0] << 16 |
+	    eaddr[1] << 8 | eaddr[2]);
+	EMAC_WRITE_REG(sc, EMAC_MAC_A0, eaddr[3] << 16 |
+	    eaddr[4] << 8 | eaddr[5]);
+
+	/* Setup rx filter */
+	emac_set_rx_mode(sc);
+
+	/* Enable RX/TX0/RX Hlevel interrupt */
+#ifdef DEVICE_POLLING
+	/* ...only if polling is not turned on. */
+	if ((ifp->if_capenable & IFCAP_POLLING) == 0)
+#endif
+	{
+		reg_val = EMAC_READ_REG(sc, EMAC_INT_CTL);
+		reg_val |= EMAC_INT_EN;
+		EMAC_WRITE_REG(sc, EMAC_INT_CTL, reg_val);
+	}
+
+	emac_rx_cache_fill(sc);
+
+	ifp->if_drv_flags |= IFF_DRV_RUNNING;
+	ifp->if_drv_flags &= ~IFF_DRV_OACTIVE;
+
+	sc->emac_link = 0;
+	sc->emac_fifo_mask = 0;
+
+	/* Switch to the current media, that may sleep. */
+	atomic_store_rel_int(&sc->emac_mii_mediachg, 1);
+	taskqueue_enqueue(taskqueue_thread, &sc->emac_mii_task);
+
+	callout_reset(&sc->emac_tick_ch, hz, emac_tick, sc);
+}
+
+
+static int
+emac_transmit(struct ifnet *ifp, struct mbuf *m)
+{
+	struct emac_softc *sc;
+	int error;
+
+	sc = ifp->if_softc;
+	error = drbr_enqueue(ifp, sc->emac_br, m);
+	if (error != 0)
+		return (error);
+
+	/*
+	 * Drain the ring ourselves if nobody else is holding the lock,
+	 * otherwise leave it to the taskqueue rather than spin here.
+	 */
+	if (EMAC_TX_TRYLOCK(sc)) {
+		emac_start_locked(sc);
+		EMAC_TX_UNLOCK(sc);
+	} else
+		taskqueue_enqueue(sc->emac_tq, &sc->emac_tx_task);
+
+	return (0);
+}
+
+static void
+emac_qflush(struct ifnet *ifp)
+{
+	struct emac_softc *sc;
+	struct mbuf *m;
+
+	sc = ifp->if_softc;
+	EMAC_TX_LOCK(sc);
+	while ((m = buf_ring_dequeue_sc(sc->emac_br)) != NULL)
+		m_freem(m);
+	/* Do not resume a super-segment after the flush. */
+	if (sc->emac_tso_m != NULL) {
+		m_freem(sc->emac_tso_m);
+		sc->emac_tso_m = NULL;
+	}
+	EMAC_TX_UNLOCK(sc);
+	if_qflush(ifp);
+}
+
+static void
+emac_tx_task(void *arg, int pending)
+{
+	struct emac_softc *sc;
+
+	sc = (struct emac_softc *)arg;
+	EMAC_TX_LOCK(sc);
+	if (emac_tx_pending(sc))
+		emac_start_locked(sc);
+	EMAC_TX_UNLOCK(sc);
+}
+
+/* Anything queued or a super-segment not yet fully cut? */
+static __inline int
+emac_tx_pending(struct emac_softc *sc)
+{
+
+	return (sc->emac_tso_m != NULL ||
+	    !drbr_empty(sc->emac_ifp, sc->emac_br));
+}
+
+static void
+emac_start_locked(struct emac_softc *sc)
+{
+	struct ifnet *ifp;
+	struct mbuf *m;
+	uint32_t fifo;
+	int len;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	ifp = sc->emac_ifp;
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0 ||
+	    (ifp->if_drv_flags & IFF_DRV_OACTIVE) != 0)
+		return;
+	if (sc->emac_link == 0)
+		return;
+
+	/*
+	 * The controller has two TX FIFO channels.  Fill the idle one
+	 * while the other is being transmitted so the wire does not go
+	 * quiet between a completion interrupt and the next FIFO fill.
+	 * While a DMA transfer owns the FIFO nothing else may touch it,
+	 * the completion handler calls us again.  A TSO super-segment
+	 * is cut into one frame per channel fill until it is used up.
+	 */
+	while (sc->emac_fifo_mask != EMAC_TX_FIFO_ALL &&
+	    sc->emac_tx_dma_m == NULL) {
+		m = NULL;
+		if (sc->emac_tso_m == NULL) {
+			m = drbr_dequeue(ifp, sc->emac_br);
+			if (m == NULL)
+				break;
+#if defined(INET) || defined(INET6)
+			if ((m->m_pkthdr.csum_flags & CSUM_TSO) != 0) {
+				if (emac_tso_start(sc, m) != 0) {
+					if_inc_counter(ifp, IFCOUNTER_OERRORS,
+					    1);
+					m_freem(m);
+					continue;
+				}
+				BPF_MTAP(ifp, m);
+				m = NULL;
+			} else if ((m->m_pkthdr.csum_flags &
+			    (EMAC_CSUM_FEATURES | EMAC_CSUM6_FEATURES)) != 0)
+				emac_txcsum(m);
+#endif
+		}
+
+		/* Select channel */
+		if (sc->emac_fifo_mask & EMAC_TX_FIFO0)
+			fifo = 1;
+		else
+			fifo = 0;
+
+		if (m != NULL && sc->emac_tx_dma != NULL &&
+		    emac_txdma_start(sc, m, fifo) == 0)
+			break;
+
+		sc->emac_fifo_mask |= (1 << fifo);
+		EMAC_WRITE_REG(sc, EMAC_TX_INS, fifo);
+
+		/* Write data */
+#if defined(INET) || defined(INET6)
+		if (m == NULL)
+			len = emac_tso_next(sc);
+		else
+#endif
+		{
+			emac_txfifo_write(sc, m);
+			len = m->m_pkthdr.len;
+		}
+
+		emac_txfifo_send(sc, fifo, len);
+
+		if (m != NULL) {
+			BPF_MTAP(ifp, m);
+			m_freem(m);
+		}
+	}
+	if (sc->emac_fifo_mask == EMAC_TX_FIFO_ALL)
+		ifp->if_drv_flags |= IFF_DRV_OACTIVE;
+}
+
+/*
+ * Stream bytes into the selected TX FIFO.  The FIFO only takes whole
+ * little-endian words, so up to three bytes left over at the end of one
+ * buffer are carried into the next and aligned runs go out with a
+ * single bus_space_write_multi_4().
+ */
+static void
+emac_txfifo_put(struct emac_softc *sc, struct emac_txfifo *tf,
+    const uint8_t *p, int len)
+{
+	int i, nwords;
+
+	/* Complete the word left over from the previous buffer. */
+	while (tf->tf_shift != 0 && len > 0) {
+		tf->tf_carry |= (uint32_t)*p++ << tf->tf_shift;
+		len--;
+		tf->tf_shift += 8;
+		if (tf->tf_shift == 32) {
+			EMAC_WRITE_REG(sc, EMAC_TX_IO_DATA, tf->tf_carry);
+			tf->tf_carry = 0;
+			tf->tf_shift = 0;
+		}
+	}
+
+	nwords = len / 4;
+	if (nwords > 0 && ((uintptr_t)p & 3) == 0)
+		bus_space_write_multi_4(sc->emac_tag, sc->emac_handle,
+		    EMAC_TX_IO_DATA, (const uint32_t *)p, nwords);
+	else
+		for (i = 0; i < nwords; i++)
+			EMAC_WRITE_REG(sc, EMAC_TX_IO_DATA,
+			    le32dec(p + i * 4));
+	p += nwords * 4;
+	len -= nwords * 4;
+
+	for (; len > 0; len--, tf->tf_shift += 8)
+		tf->tf_carry |= (uint32_t)*p++ << tf->tf_shift;
+}
+
+/* Stream len bytes of an mbuf chain, starting at off. */
+static void
+emac_txfifo_copy(struct emac_softc *sc, struct emac_txfifo *tf,
+    struct mbuf *m, int off, int len)
+{
+	int n;
+
+	for (; m != NULL && off >= m->m_len; m = m->m_next)
+		off -= m->m_len;
+	for (; m != NULL && len > 0; m = m->m_next, off = 0) {
+		n = min(m->m_len - off, len);
+		emac_txfifo_put(sc, tf, mtod(m, uint8_t *) + off, n);
+		len -= n;
+	}
+}
+
+static void
+emac_txfifo_flush(struct emac_softc *sc, struct emac_txfifo *tf)
+{
+
+	if (tf->tf_shift != 0)
+		EMAC_WRITE_REG(sc, EMAC_TX_IO_DATA, tf->tf_carry);
+	tf->tf_carry = 0;
+	tf->tf_shift = 0;
+}
+
+static void
+emac_txfifo_write(struct emac_softc *sc, struct mbuf *m)
+{
+	struct emac_txfifo tf;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	tf.tf_carry = 0;
+	tf.tf_shift = 0;
+	emac_txfifo_copy(sc, &tf, m, 0, m->m_pkthdr.len);
+	emac_txfifo_flush(sc, &tf);
+}
+
+/*
+ * Hand a filled FIFO channel to the MAC.
+ */
+static void
+emac_txfifo_send(struct emac_softc *sc, uint32_t fifo, int len)
+{
+	uint32_t reg;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	/* Send the data lengh. */
+	reg = (fifo == 0) ? EMAC_TX_PL0 : EMAC_TX_PL1;
+	EMAC_WRITE_REG(sc, reg, len);
+
+	/* Start translate from fifo to phy. */
+	reg = (fifo == 0) ? EMAC_TX_CTL0 : EMAC_TX_CTL1;
+	EMAC_WRITE_REG(sc, reg, EMAC_READ_REG(sc, reg) | 1);
+
+	/* Set timeout */
+	sc->emac_watchdog_timer = 5;
+}
+
+#if defined(INET) || defined(INET6)
+/*
+ * Fill in the checksums the stack left to us.  The checksum field goes
+ * into the FIFO ahead of the data it covers, so it cannot be summed
+ * during emac_txfifo_write(); it is done right before it instead and
+ * the payload is still in the cache when it is streamed out.
+ */
+static void
+emac_txcsum(struct mbuf *m)
+{
+	struct ether_header eh;
+#ifdef INET
+	struct ip ip;
+#endif
+#ifdef INET6
+	struct ip6_hdr ip6;
+#endif
+	uint16_t csum;
+	int l3off, l4off, l4end;
+
+	if (m->m_pkthdr.len < ETHER_HDR_LEN)
+		return;
+	m_copydata(m, 0, ETHER_HDR_LEN, (caddr_t)&eh);
+	l3off = ETHER_HDR_LEN;
+
+	switch (ntohs(eh.ether_type)) {
+#ifdef INET
+	case ETHERTYPE_IP:
+		if (m->m_pkthdr.len < l3off + sizeof(struct ip))
+			return;
+		m_copydata(m, l3off, sizeof(struct ip), (caddr_t)&ip);
+		l4off = l3off + (ip.ip_hl << 2);
+		l4end = l3off + ntohs(ip.ip_len);
+		if ((m->m_pkthdr.csum_flags & CSUM_IP) != 0) {
+			csum = in_cksum_skip(m, l4off, l3off);
+			m_copyback(m, l3off + offsetof(struct ip, ip_sum),
+			    sizeof(csum), (caddr_t)&csum);
+		}
+		break;
+#endif
+#ifdef INET6
+	case ETHERTYPE_IPV6:
+		if (m->m_pkthdr.len < l3off + sizeof(struct ip6_hdr))
+			return;
+		m_copydata(m, l3off, sizeof(struct ip6_hdr), (caddr_t)&ip6);
+		/* Like ip6_output(), assume no extension headers. */
+		l4off = l3off + sizeof(struct ip6_hdr);
+		l4end = l4off + ntohs(ip6.ip6_plen);
+		break;
+#endif
+	default:
+		return;
+	}
+	if ((m->m_pkthdr.csum_flags &
+	    (CSUM_TCP | CSUM_UDP | EMAC_CSUM6_FEATURES)) == 0 ||
+	    l4end > m->m_pkthdr.len)
+		return;
+
+	/* The stack has seeded the field with the pseudo header sum. */
+	csum = in_cksum_skip(m, l4end, l4off);
+	if (csum == 0 &&
+	    (m->m_pkthdr.csum_flags & (CSUM_UDP | CSUM_UDP_IPV6)) != 0)
+		csum = 0xffff;
+	m_copyback(m, l4off + m->m_pkthdr.csum_data, sizeof(csum),
+	    (caddr_t)&csum);
+}
+
+/*
+ * Take a TSO super-segment from the stack.  The L2-L4 headers are
+ * copied aside, IP header 32-bit aligned, and replayed in front of
+ * every MSS sized slice of the payload by emac_tso_next().
+ */
+static int
+emac_tso_start(struct emac_softc *sc, struct mbuf *m)
+{
+	struct ether_header *eh;
+#ifdef INET
+	struct ip *ip;
+#endif
+#ifdef INET6
+	struct ip6_hdr *ip6;
+#endif
+	struct tcphdr *th;
+	uint8_t *hdr;
+	int clen, hlen, l4off;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	hdr = (uint8_t *)sc->emac_tso_hdr + ETHER_ALIGN;
+	clen = min(m->m_pkthdr.len, EMAC_TSO_HDR_MAX);
+	if (clen < ETHER_HDR_LEN)
+		return (EINVAL);
+	m_copydata(m, 0, clen, hdr);
+	eh = (struct ether_header *)hdr;
+
+	switch (ntohs(eh->ether_type)) {
+#ifdef INET
+	case ETHERTYPE_IP:
+		if (clen < ETHER_HDR_LEN + sizeof(struct ip))
+			return (EINVAL);
+		ip = (struct ip *)(hdr + ETHER_HDR_LEN);
+		if (ip->ip_p != IPPROTO_TCP)
+			return (EINVAL);
+		l4off = ETHER_HDR_LEN + (ip->ip_hl << 2);
+		sc->emac_tso_ipv6 = 0;
+		sc->emac_tso_id = ntohs(ip->ip_id);
+		break;
+#endif
+#ifdef INET6
+	case ETHERTYPE_IPV6:
+		if (clen < ETHER_HDR_LEN + sizeof(struct ip6_hdr))
+			return (EINVAL);
+		ip6 = (struct ip6_hdr *)(hdr + ETHER_HDR_LEN);
+		if (ip6->ip6_nxt != IPPROTO_TCP)
+			return (EINVAL);
+		l4off = ETHER_HDR_LEN + sizeof(struct ip6_hdr);
+		sc->emac_tso_ipv6 = 1;
+		break;
+#endif
+	default:
+		return (EINVAL);
+	}
+	if (l4off + sizeof(struct tcphdr) > clen)
+		return (EINVAL);
+	th = (struct tcphdr *)(hdr + l4off);
+	hlen = l4off + (th->th_off << 2);
+	if (hlen > clen || hlen >= m->m_pkthdr.len ||
+	    m->m_pkthdr.tso_segsz == 0 ||
+	    hlen + m->m_pkthdr.tso_segsz > EMAC_MAC_MFL - ETHER_CRC_LEN)
+		return (EINVAL);
+
+	sc->emac_tso_m = m;
+	sc->emac_tso_hlen = hlen;
+	sc->emac_tso_l4off = l4off;
+	sc->emac_tso_off = 0;
+	sc->emac_tso_mss = m->m_pkthdr.tso_segsz;
+	sc->emac_tso_seg = 0;
+	sc->emac_tso_seq = ntohl(th->th_seq);
+	sc->emac_tso_flags = th->th_flags;
+	sc->emac_stat_tso++;
+
+	return (0);
+}
+
+/*
+ * Write the next frame of the current super-segment to the selected
+ * FIFO channel and return its length.  Sequence number, IP ID and
+ * lengths are fixed up in the saved headers and both checksums are
+ * recomputed; the payload goes straight from the chain to the FIFO.
+ */
+static int
+emac_tso_next(struct emac_softc *sc)
+{
+#ifdef INET
+	struct ip *ip;
+#endif
+#ifdef INET6
+	struct ip6_hdr *ip6;
+#endif
+	struct emac_txfifo tf;
+	struct tcphdr *th;
+	struct mbuf *m;
+	uint8_t *hdr;
+	uint64_t sum;
+	int hlen, l4off, last, off, seglen, tcplen;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	m = sc->emac_tso_m;
+	hdr = (uint8_t *)sc->emac_tso_hdr + ETHER_ALIGN;
+	hlen = sc->emac_tso_hlen;
+	l4off = sc->emac_tso_l4off;
+	off = hlen + sc->emac_tso_off;
+	seglen = min(sc->emac_tso_mss, m->m_pkthdr.len - off);
+	last = (off + seglen == m->m_pkthdr.len);
+	tcplen = hlen - l4off + seglen;
+
+	th = (struct tcphdr *)(hdr + l4off);
+	th->th_seq = htonl(sc->emac_tso_seq + sc->emac_tso_off);
+	th->th_flags = sc->emac_tso_flags;
+	if (sc->emac_tso_seg != 0)
+		th->th_flags &= ~TH_CWR;
+	if (!last)
+		th->th_flags &= ~(TH_FIN | TH_PUSH);
+	th->th_sum = 0;
+	sum = emac_cksum_range(hdr, l4off, hlen);
+
+#ifdef INET
+	if (!sc->emac_tso_ipv6) {
+		ip = (struct ip *)(hdr + ETHER_HDR_LEN);
+		ip->ip_len = htons(l4off - ETHER_HDR_LEN + tcplen);
+		ip->ip_id = htons(sc->emac_tso_id + sc->emac_tso_seg);
+		ip->ip_sum = 0;
+		ip->ip_sum = ~emac_cksum_fold(emac_cksum_range(hdr,
+		    ETHER_HDR_LEN, l4off));
+		sum += in_pseudo(ip->ip_src.s_addr, ip->ip_dst.s_addr,
+		    htonl(tcplen + IPPROTO_TCP));
+	}
+#endif
+#ifdef INET6
+	if (sc->emac_tso_ipv6) {
+		ip6 = (struct ip6_hdr *)(hdr + ETHER_HDR_LEN);
+		ip6->ip6_plen = htons(tcplen);
+		sum += in6_cksum_pseudo(ip6, tcplen, IPPROTO_TCP, 0);
+	}
+#endif
+	/* in_cksum_skip() hands back the complement, undo it. */
+	sum += ~in_cksum_skip(m, off + seglen, off) & 0xffff;
+	th->th_sum = ~emac_cksum_fold(sum);
+
+	tf.tf_carry = 0;
+	tf.tf_shift = 0;
+	emac_txfifo_put(sc, &tf, hdr, hlen);
+	emac_txfifo_copy(sc, &tf, m, off, seglen);
+	emac_txfifo_flush(sc, &tf);
+
+	sc->emac_stat_tso_segs++;
+	sc->emac_tso_seg++;
+	sc->emac_tso_off += seglen;
+	if (last) {
+		m_freem(m);
+		sc->emac_tso_m = NULL;
+	}
+
+	return (hlen + seglen);
+}
+#endif
+
+static void
+emac_dmamap_cb(void *arg, bus_dma_segment_t *segs, int nsegs, int error)
+{
+
+	if (error != 0)
+		return;
+	*(bus_addr_t *)arg = segs[0].ds_addr;
+}
+
+static int
+emac_txdma_attach(struct emac_softc *sc)
+{
+	int error;
+
+	sc->emac_tx_fifo_pa = rman_get_start(sc->emac_res) + EMAC_TX_IO_DATA;
+
+	error = bus_dma_tag_create(
+	    bus_get_dma_tag(sc->emac_dev),	/* Parent tag */
+	    1, 0,				/* alignment, boundary */
+	    BUS_SPACE_MAXADDR_32BIT,		/* lowaddr */
+	    BUS_SPACE_MAXADDR,			/* highaddr */
+	    NULL, NULL,				/* filter, filterarg */
+	    MCLBYTES, EMAC_TXDMA_NSEGS,		/* maxsize, nsegments */
+	    MCLBYTES,				/* maxsegsize */
+	    0,					/* flags */
+	    NULL, NULL,				/* lockfunc, lockarg */
+	    &sc->emac_tx_tag);
+	if (error != 0)
+		return (error);
+
+	error = bus_dmamap_create(sc->emac_tx_tag, 0, &sc->emac_tx_map);
+	if (error != 0) {
+		bus_dma_tag_destroy(sc->emac_tx_tag);
+		sc->emac_tx_tag = NULL;
+		return (error);
+	}
+
+	/* Word-aligned buffer for frame heads the DRQ cannot read. */
+	error = bus_dma_tag_create(
+	    bus_get_dma_tag(sc->emac_dev),	/* Parent tag */
+	    4, 0,				/* alignment, boundary */
+	    BUS_SPACE_MAXADDR_32BIT,		/* lowaddr */
+	    BUS_SPACE_MAXADDR,			/* highaddr */
+	    NULL, NULL,				/* filter, filterarg */
+	    EMAC_TXDMA_BOUNCE, 1,		/* maxsize, nsegments */
+	    EMAC_TXDMA_BOUNCE,			/* maxsegsize */
+	    0,					/* flags */
+	    NULL, NULL,				/* lockfunc, lockarg */
+	    &sc->emac_tx_btag);
+	if (error == 0)
+		error = bus_dmamem_alloc(sc->emac_tx_btag,
+		    (void **)&sc->emac_tx_bounce, BUS_DMA_NOWAIT,
+		    &sc->emac_tx_bmap);
+	if (error == 0)
+		error = bus_dmamap_load(sc->emac_tx_btag, sc->emac_tx_bmap,
+		    sc->emac_tx_bounce, EMAC_TXDMA_BOUNCE, emac_dmamap_cb,
+		    &sc->emac_tx_bounce_pa, BUS_DMA_NOWAIT);
+	if (error != 0) {
+		emac_txdma_detach(sc);
+		return (error);
+	}
+
+	sc->emac_tx_dma = a10_dmac_alloc(emac_txdma_done, sc);
+	if (sc->emac_tx_dma == NULL) {
+		emac_txdma_detach(sc);
+		return (ENXIO);
+	}
+
+	return (0);
+}
+
+static void
+emac_txdma_detach(struct emac_softc *sc)
+{
+
+	if (sc->emac_tx_dma != NULL) {
+		a10_dmac_free(sc->emac_tx_dma);
+		sc->emac_tx_dma = NULL;
+	}
+	if (sc->emac_tx_bounce_pa != 0) {
+		bus_dmamap_unload(sc->emac_tx_btag, sc->emac_tx_bmap);
+		sc->emac_tx_bounce_pa = 0;
+	}
+	if (sc->emac_tx_bounce != NULL) {
+		bus_dmamem_free(sc->emac_tx_btag, sc->emac_tx_bounce,
+		    sc->emac_tx_bmap);
+		sc->emac_tx_bounce = NULL;
+	}
+	if (sc->emac_tx_btag != NULL) {
+		bus_dma_tag_destroy(sc->emac_tx_btag);
+		sc->emac_tx_btag = NULL;
+	}
+	if (sc->emac_tx_map != NULL) {
+		bus_dmamap_destroy(sc->emac_tx_tag, sc->emac_tx_map);
+		sc->emac_tx_map = NULL;
+	}
+	if (sc->emac_tx_tag != NULL) {
+		bus_dma_tag_destroy(sc->emac_tx_tag);
+		sc->emac_tx_tag = NULL;
+	}
+}
+
+/*
+ * The FIFO takes whole 32-bit words, so all but the last segment must
+ * be a multiple of 4 long.  Segments are read in half words when they
+ * do not start on a word boundary, so they must at least start on a
+ * half word one.
+ */
+static int
+emac_txdma_check(bus_dma_segment_t *segs, int nsegs)
+{
+	int i;
+
+	for (i = 0; i < nsegs; i++) {
+		if ((segs[i].ds_addr & 1) != 0)
+			return (EFBIG);
+		if (i != nsegs - 1 && (segs[i].ds_len & 3) != 0)
+			return (EFBIG);
+	}
+
+	return (0);
+}
+
+static int
+emac_txdma_next(struct emac_softc *sc)
+{
+	struct a10_dmac_config conf;
+	bus_dma_segment_t *seg;
+
+	seg = &sc->emac_tx_segs[sc->emac_tx_seg];
+
+	conf.src_drq = A10_DDMA_DRQ_SDRAM;
+	conf.src_mode = A10_DDMA_ADDR_LINEAR;
+	if ((seg->ds_addr & 3) == 0)
+		conf.src_width = A10_DMA_WIDTH_32;
+	else
+		conf.src_width = A10_DMA_WIDTH_16;
+	conf.src_burst = A10_DMA_BURST_4;
+	conf.dst_drq = A10_DDMA_DRQ_EMAC_TX;
+	conf.dst_mode = A10_DDMA_ADDR_IO;
+	conf.dst_width = A10_DMA_WIDTH_32;
+	conf.dst_burst = A10_DMA_BURST_1;
+
+	return (a10_dmac_transfer(sc->emac_tx_dma, &conf, seg->ds_addr,
+	    sc->emac_tx_fifo_pa, roundup2(seg->ds_len, 4)));
+}
+
+/*
+ * Take the frame back from the DRQ and give the FIFO back to the CPU.
+ */
+static struct mbuf *
+emac_txdma_release(struct emac_softc *sc)
+{
+	struct mbuf *m;
+	uint32_t reg_val;
+
+	m = sc->emac_tx_dma_m;
+	sc->emac_tx_dma_m = NULL;
+	bus_dmamap_sync(sc->emac_tx_tag, sc->emac_tx_map,
+	    BUS_DMASYNC_POSTWRITE);
+	bus_dmamap_unload(sc->emac_tx_tag, sc->emac_tx_map);
+	bus_dmamap_sync(sc->emac_tx_btag, sc->emac_tx_bmap,
+	    BUS_DMASYNC_POSTWRITE);
+
+	reg_val = EMAC_READ_REG(sc, EMAC_TX_MODE);
+	reg_val &= ~EMAC_TX_DMA;
+	EMAC_WRITE_REG(sc, EMAC_TX_MODE, reg_val);
+
+	return (m);
+}
+
+static int
+emac_txdma_start(struct emac_softc *sc, struct mbuf *m, uint32_t fifo)
+{
+	bus_dma_segment_t *segs;
+	uint32_t reg_val;
+	int error, first, hlen, nsegs, skip;
+
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	/* Slot 0 is kept for the bounce buffer. */
+	segs = sc->emac_tx_segs;
+	error = bus_dmamap_load_mbuf_sg(sc->emac_tx_tag, sc->emac_tx_map, m,
+	    &segs[1], &nsegs, BUS_DMA_NOWAIT);
+	if (error != 0)
+		return (error);
+	first = 1;
+
+	/*
+	 * Frames built by the stack have the Ethernet header at 2 mod 4
+	 * and a header mbuf that is not a multiple of 4 long either.
+	 * Copy the frame up to the first word boundary past that mbuf
+	 * into the bounce buffer; the rest then starts on a half word
+	 * boundary, which the DRQ can read from.
+	 */
+	if (emac_txdma_check(&segs[1], nsegs) != 0) {
+		hlen = min(roundup2(segs[1].ds_len, 4), m->m_pkthdr.len);
+		if (hlen > EMAC_TXDMA_BOUNCE) {
+			bus_dmamap_unload(sc->emac_tx_tag, sc->emac_tx_map);
+			return (EFBIG);
+		}
+		m_copydata(m, 0, hlen, sc->emac_tx_bounce);
+		bus_dmamap_sync(sc->emac_tx_btag, sc->emac_tx_bmap,
+		    BUS_DMASYNC_PREWRITE);
+
+		/* Cut the copied bytes off the segment list. */
+		for (skip = hlen; nsegs > 0 && skip >= segs[first].ds_len;
+		    nsegs--, first++)
+			skip -= segs[first].ds_len;
+		if (nsegs > 0) {
+			segs[first].ds_addr += skip;
+			segs[first].ds_len -= skip;
+		}
+		first--;
+		nsegs++;
+		segs[first].ds_addr = sc->emac_tx_bounce_pa;
+		segs[first].ds_len = hlen;
+	}
+	/*
+	 * Chains the DRQ still cannot take go out by PIO, which streams
+	 * them without a copy, rather than being defragmented.
+	 */
+	if (emac_txdma_check(&segs[first], nsegs) != 0) {
+		bus_dmamap_unload(sc->emac_tx_tag, sc->emac_tx_map);
+		return (EFBIG);
+	}
+	bus_dmamap_sync(sc->emac_tx_tag, sc->emac_tx_map,
+	    BUS_DMASYNC_PREWRITE);
+
+	sc->emac_fifo_mask |= (1 << fifo);
+	EMAC_WRITE_REG(sc, EMAC_TX_INS, fifo);
+
+	/* Hand the FIFO over to the DRQ line for this frame. */
+	reg_val = EMAC_READ_REG(sc, EMAC_TX_MODE);
+	reg_val |= EMAC_TX_DMA;
+	EMAC_WRITE_REG(sc, EMAC_TX_MODE, reg_val);
+
+	sc->emac_tx_dma_m = m;
+	sc->emac_tx_dma_fifo = fifo;
+	sc->emac_tx_nsegs = first + nsegs;
+	sc->emac_tx_seg = first;
+	sc->emac_tx_off = 0;
+	error = emac_txdma_next(sc);
+	if (error != 0) {
+		/* The caller sends it by PIO instead. */
+		(void)emac_txdma_release(sc);
+		sc->emac_fifo_mask &= ~(1 << fifo);
+		return (error);
+	}
+
+	/* Set timeout */
+	sc->emac_watchdog_timer = 5;
+
+	return (0);
+}
+
 static void
-emac_start(struct ifnet *ifp)
+emac_txdma_stop(struct emac_softc *sc)
 {
-	struct emac_softc *sc;
 
-	sc = ifp->if_softc;
-	EMAC_LOCK(sc);
-	emac_start_locked(ifp);
-	EMAC_UNLOCK(sc);
+	EMAC_TX_ASSERT_LOCKED(sc);
+
+	if (sc->emac_tx_dma_m == NULL)
+		return;
+
+	a10_dmac_halt(sc->emac_tx_dma);
+	m_freem(emac_txdma_release(sc));
 }
 
 static void
-emac_start_locked(struct ifnet *ifp)
+emac_txdma_done(void *arg)
 {
 	struct emac_softc *sc;
-	struct mbuf *m, *m0;
-	uint32_t reg_val;
+	struct emac_txfifo tf;
+	struct ifnet *ifp;
+	struct mbuf *m;
+	int off;
 
-	sc = ifp->if_softc;
-	if (ifp->if_drv_flags & IFF_DRV_OACTIVE)
-		return;
-	if (sc->emac_link == 0)
-		return;
-	IFQ_DRV_DEQUEUE(&ifp->if_snd, m);
-	if (m == NULL)
+	sc = (struct emac_softc *)arg;
+	EMAC_TX_LOCK(sc);
+	if (sc->emac_tx_dma_m == NULL) {
+		EMAC_TX_UNLOCK(sc);
 		return;
-
-	/* Select channel */
-	EMAC_WRITE_REG(sc, EMAC_TX_INS, 0);
-
-	/*
-	 * Emac controller wants 4 byte aligned TX buffers.
-	 * We have to copy pretty much all the time.
-	 */
-	if (m->m_next != NULL || (mtod(m, uintptr_t) & 3) != 0) {
-		m0 = m_defrag(m, M_NOWAIT);
-		if (m0 == NULL) {
-			m_freem(m);
-			m = NULL;
+	}
+	sc->emac_tx_off += sc->emac_tx_segs[sc->emac_tx_seg].ds_len;
+	if (++sc->emac_tx_seg < sc->emac_tx_nsegs) {
+		if (emac_txdma_next(sc) == 0) {
+			EMAC_TX_UNLOCK(sc);
 			return;
 		}
-		m = m0;
-	}
-	/* Write data */
-	bus_space_write_multi_4(sc->emac_tag, sc->emac_handle,
-	    EMAC_TX_IO_DATA, mtod(m, uint32_t *),
-	    roundup2(m->m_len, 4) / 4);
-
-	/* Send the data lengh. */
-	EMAC_WRITE_REG(sc, EMAC_TX_PL0, m->m_len);
-
-	/* Start translate from fifo to phy. */
-	reg_val = EMAC_READ_REG(sc, EMAC_TX_CTL0);
-	reg_val |= 1;
-	EMAC_WRITE_REG(sc, EMAC_TX_CTL0, reg_val);
+		/*
+		 * Could not queue the next segment.  The ones done so
+		 * far are whole words, so finish the frame by PIO.
+		 */
+		off = sc->emac_tx_off;
+		m = emac_txdma_release(sc);
+		tf.tf_carry = 0;
+		tf.tf_shift = 0;
+		emac_txfifo_copy(sc, &tf, m, off, m->m_pkthdr.len - off);
+		emac_txfifo_flush(sc, &tf);
+	} else
+		m = emac_txdma_release(sc);
 
-	/* Set timeout */
-	sc->emac_watchdog_timer = 5;
+	emac_txfifo_send(sc, sc->emac_tx_dma_fifo, m->m_pkthdr.len);
 
-	ifp->if_drv_flags |= IFF_DRV_OACTIVE;
+	ifp = sc->emac_ifp;
 	BPF_MTAP(ifp, m);
 	m_freem(m);
+
+	if (emac_tx_pending(sc))
+		emac_start_locked(sc);
+	EMAC_TX_UNLOCK(sc);
 }
 
 static void
@@ -641,6 +2478,7 @@ emac_stop_locked(struct emac_softc *sc)
 	ifp = sc->emac_ifp;
 	ifp->if_drv_flags &= ~(IFF_DRV_RUNNING | IFF_DRV_OACTIVE);
 	sc->emac_link = 0;
+	sc->emac_fifo_mask = 0;
 
 	/* Disable all interrupt and clear interrupt status */
 	EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
@@ -652,48 +2490,257 @@ emac_stop_locked(struct emac_softc *sc)
 	reg_val &= ~(EMAC_CTL_RST | EMAC_CTL_TX_EN | EMAC_CTL_RX_EN);
 	EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
 
+	/* Stop asserting flow control */
+	EMAC_WRITE_REG(sc, EMAC_TX_FLOW, 0);
+	sc->emac_fc_on = 0;
+
+	/* Abort in-flight DMA transfers */
+	emac_rxdma_stop(sc);
+	emac_txdma_stop(sc);
+
+	/* Drop what is left of a TSO super-segment */
+	if (sc->emac_tso_m != NULL) {
+		m_freem(sc->emac_tso_m);
+		sc->emac_tso_m = NULL;
+	}
+
 	callout_stop(&sc->emac_tick_ch);
+	callout_stop(&sc->emac_holdoff_ch);
 }
 
-static void
+static int
 emac_intr(void *arg)
 {
 	struct emac_softc *sc;
-	struct ifnet *ifp;
 	uint32_t reg_val;
 
 	sc = (struct emac_softc *)arg;
-	EMAC_LOCK(sc);
-	ifp = sc->emac_ifp;
-	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0)
-		return;
 
-	/* Disable all interrupts */
-	EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
 	/* Get EMAC interrupt status */
 	reg_val = EMAC_READ_REG(sc, EMAC_INT_STA);
+	if (reg_val == 0)
+		return (FILTER_STRAY);
+
+	/* Disable all interrupts */
+	EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
 	/* Clear ISR status */
 	EMAC_WRITE_REG(sc, EMAC_INT_STA, reg_val);
 
+	/* Leave the FIFO work to the taskqueue. */
+	sc->emac_stat_intrs++;
+	atomic_set_32(&sc->emac_intr_status, reg_val);
+	taskqueue_enqueue(sc->emac_tq, &sc->emac_int_task);
+
+	return (FILTER_HANDLED);
+}
+
+static void
+emac_int_task(void *arg, int pending)
+{
+	struct emac_softc *sc;
+	struct ifnet *ifp;
+	struct mbuf *m, *n;
+	uint32_t reg_val;
+	int nframes;
+#ifdef DEV_NETMAP
+	u_int work_done;
+#endif
+
+	sc = (struct emac_softc *)arg;
+	reg_val = atomic_readandclear_32(&sc->emac_intr_status);
+	ifp = sc->emac_ifp;
+
+#ifdef DEV_NETMAP
+	/*
+	 * In netmap mode the FIFO is drained by rxsync instead.  The
+	 * notification may run rxsync right away, so no lock here.
+	 */
+	if ((reg_val & EMAC_INT_STA_RX) != 0 &&
+	    netmap_rx_irq(ifp, 0, &work_done) != 0)
+		reg_val &= ~EMAC_INT_STA_RX;
+#endif
+
+	EMAC_RX_LOCK(sc);
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0) {
+		EMAC_RX_UNLOCK(sc);
+		return;
+	}
+
 	/* Received incoming packet */
-	if (reg_val & EMAC_INT_STA_RX)
-		emac_rxeof(sc, sc->emac_rx_process_limit);
+	m = NULL;
+	if (reg_val & EMAC_INT_STA_RX) {
+		m = emac_rxeof(sc, sc->emac_rx_process_limit);
+		emac_rx_cache_fill(sc);
+	}
+	EMAC_RX_UNLOCK(sc);
+
+	nframes = 0;
+	for (n = m; n != NULL; n = n->m_nextpkt)
+		nframes++;
+	sc->emac_stat_rx_frames += nframes;
 
+	/* Hand the whole batch to the stack in one go. */
+	if (m != NULL)
+		emac_rxinput(sc, m);
+
+	/*
+	 * Init and stop hold both locks, so the TX lock alone is
+	 * enough to serialize the interrupt mask against them.
+	 */
+	EMAC_TX_LOCK(sc);
 	/* Transmit Interrupt check */
 	if (reg_val & EMAC_INT_STA_TX){
-		emac_txeof(sc);
-		if (!IFQ_DRV_IS_EMPTY(&ifp->if_snd))
-			emac_start_locked(ifp);
+		emac_txeof(sc, reg_val);
+#ifdef DEV_NETMAP
+		if (netmap_tx_irq(ifp, 0) == 0 && emac_tx_pending(sc))
+#else
+		if (emac_tx_pending(sc))
+#endif
+			emac_start_locked(sc);
 	}
 
-	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) != 0) {
+#ifdef DEVICE_POLLING
+	if ((ifp->if_capenable & IFCAP_POLLING) != 0) {
+		EMAC_TX_UNLOCK(sc);
+		return;
+	}
+#endif
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0) {
+		EMAC_TX_UNLOCK(sc);
+		return;
+	}
+	if (sc->emac_holdoff_us > 0 && nframes >= sc->emac_holdoff_frames) {
+		/*
+		 * Busy enough: keep RX masked for the holdoff period and
+		 * poll once when it expires instead of taking an interrupt
+		 * for each frame arriving in the meantime.  TX completions
+		 * stay enabled so the FIFO channels keep being refilled.
+		 */
+		sc->emac_stat_holdoffs++;
+		callout_reset_sbt(&sc->emac_holdoff_ch,
+		    SBT_1US * sc->emac_holdoff_us, 0, emac_holdoff, sc,
+		    C_DIRECT_EXEC);
+		EMAC_WRITE_REG(sc, EMAC_INT_CTL,
+		    EMAC_INT_EN & ~EMAC_INT_STA_RX);
+	} else if (callout_pending(&sc->emac_holdoff_ch)) {
+		/* A TX completion during holdoff, leave RX masked. */
+		EMAC_WRITE_REG(sc, EMAC_INT_CTL,
+		    EMAC_INT_EN & ~EMAC_INT_STA_RX);
+	} else {
 		/* Re-enable interrupt mask */
 		reg_val = EMAC_READ_REG(sc, EMAC_INT_CTL);
 		reg_val |= EMAC_INT_EN;
 		EMAC_WRITE_REG(sc, EMAC_INT_CTL, reg_val);
 	}
-	EMAC_UNLOCK(sc);
+	EMAC_TX_UNLOCK(sc);
+}
+
+/*
+ * Pass a receive batch from the interrupt task to the stack.  With LRO
+ * on, TCP segments with a verified checksum are merged first and the
+ * rest of the batch follows once every flow has been flushed; the task
+ * is the only consumer of the LRO state, so it needs no lock.
+ */
+static void
+emac_rxinput(struct emac_softc *sc, struct mbuf *m)
+{
+	struct ifnet *ifp;
+#if defined(INET) || defined(INET6)
+	struct lro_ctrl *lro;
+	struct lro_entry *queued;
+	struct mbuf *mh, **mt, *next;
+#endif
+
+	ifp = sc->emac_ifp;
+#if defined(INET) || defined(INET6)
+	lro = &sc->emac_lro;
+	if ((ifp->if_capenable & IFCAP_LRO) != 0 && lro->ifp != NULL) {
+		mh = NULL;
+		mt = &mh;
+		for (; m != NULL; m = next) {
+			next = m->m_nextpkt;
+			m->m_nextpkt = NULL;
+			/*
+			 * A merged segment goes up marked as checksummed,
+			 * so only take frames whose sum was verified.
+			 */
+			if ((m->m_pkthdr.csum_flags & (CSUM_DATA_VALID |
+			    CSUM_PSEUDO_HDR)) == (CSUM_DATA_VALID |
+			    CSUM_PSEUDO_HDR) && tcp_lro_rx(lro, m, 0) == 0)
+				continue;
+			*mt = m;
+			mt = &m->m_nextpkt;
+		}
+		while ((queued = SLIST_FIRST(&lro->lro_active)) != NULL) {
+			SLIST_REMOVE_HEAD(&lro->lro_active, next);
+			tcp_lro_flush(lro, queued);
+		}
+		m = mh;
+		if (m == NULL)
+			return;
+	}
+#endif
+	(*ifp->if_input)(ifp, m);
+}
+
+static void
+emac_holdoff(void *arg)
+{
+	struct emac_softc *sc;
+	uint32_t reg_val;
+
+	sc = (struct emac_softc *)arg;
+
+	/*
+	 * Runs from the event timer interrupt: pick up whatever was
+	 * latched while masked and poll the FIFO once from the task.
+	 */
+	reg_val = EMAC_READ_REG(sc, EMAC_INT_STA);
+	EMAC_WRITE_REG(sc, EMAC_INT_STA, reg_val);
+	atomic_set_32(&sc->emac_intr_status, reg_val | EMAC_INT_STA_RX);
+	taskqueue_enqueue(sc->emac_tq, &sc->emac_int_task);
+}
+
+#ifdef DEVICE_POLLING
+static int
+emac_poll(struct ifnet *ifp, enum poll_cmd cmd, int count)
+{
+	struct emac_softc *sc;
+	struct mbuf *m, *n;
+	uint32_t reg_val;
+	int rx_npkts;
+
+	sc = ifp->if_softc;
+	rx_npkts = 0;
+	EMAC_RX_LOCK(sc);
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0) {
+		EMAC_RX_UNLOCK(sc);
+		return (rx_npkts);
+	}
+
+	/* Interrupts are masked, but the status is still latched. */
+	reg_val = EMAC_READ_REG(sc, EMAC_INT_STA);
+	EMAC_WRITE_REG(sc, EMAC_INT_STA, reg_val);
+
+	m = emac_rxeof(sc, count);
+	emac_rx_cache_fill(sc);
+	EMAC_RX_UNLOCK(sc);
+
+	for (n = m; n != NULL; n = n->m_nextpkt)
+		rx_npkts++;
+	if (m != NULL)
+		(*ifp->if_input)(ifp, m);
+
+	EMAC_TX_LOCK(sc);
+	if (reg_val & EMAC_INT_STA_TX)
+		emac_txeof(sc, reg_val);
+	if (emac_tx_pending(sc))
+		emac_start_locked(sc);
+	EMAC_TX_UNLOCK(sc);
+
+	return (rx_npkts);
 }
+#endif /* DEVICE_POLLING */
 
 static int
 emac_ioctl(struct ifnet *ifp, u_long command, caddr_t data)
@@ -701,7 +2748,10 @@ emac_ioctl(struct ifnet *ifp, u_long command, caddr_t data)
 	struct emac_softc *sc;
 	struct mii_data *mii;
 	struct ifreq *ifr;
-	int error = 0;
+#ifdef DEVICE_POLLING
+	uint32_t reg_val;
+#endif
+	int error = 0, mask;
 
 	sc = ifp->if_softc;
 	ifr = (struct ifreq *)data;
@@ -725,17 +2775,85 @@ emac_ioctl(struct ifnet *ifp, u_long command, caddr_t data)
 		break;
 	case SIOCADDMULTI:
 	case SIOCDELMULTI:
-		EMAC_LOCK(sc);
+		EMAC_RX_LOCK(sc);
 		if (ifp->if_drv_flags & IFF_DRV_RUNNING) {
 			emac_set_rx_mode(sc);
 		}
-		EMAC_UNLOCK(sc);
+		EMAC_RX_UNLOCK(sc);
+		break;
+	case SIOCSIFCAP:
+		mask = ifr->ifr_reqcap ^ ifp->if_capenable;
+#ifdef DEVICE_POLLING
+		if ((mask & IFCAP_POLLING) != 0) {
+			if ((ifr->ifr_reqcap & IFCAP_POLLING) != 0) {
+				error = ether_poll_register(emac_poll, ifp);
+				if (error != 0)
+					break;
+				EMAC_LOCK(sc);
+				/* Disable interrupts */
+				EMAC_WRITE_REG(sc, EMAC_INT_CTL, 0);
+				ifp->if_capenable |= IFCAP_POLLING;
+				EMAC_UNLOCK(sc);
+			} else {
+				error = ether_poll_deregister(ifp);
+				EMAC_LOCK(sc);
+				/* Enable interrupts */
+				if ((ifp->if_drv_flags & IFF_DRV_RUNNING) != 0) {
+					reg_val = EMAC_READ_REG(sc,
+					    EMAC_INT_CTL);
+					reg_val |= EMAC_INT_EN;
+					EMAC_WRITE_REG(sc, EMAC_INT_CTL,
+					    reg_val);
+				}
+				ifp->if_capenable &= ~IFCAP_POLLING;
+				EMAC_UNLOCK(sc);
+			}
+		}
+#endif
+		if ((mask & IFCAP_RXCSUM) != 0)
+			ifp->if_capenable ^= IFCAP_RXCSUM;
+		if ((mask & IFCAP_RXCSUM_IPV6) != 0)
+			ifp->if_capenable ^= IFCAP_RXCSUM_IPV6;
+		if ((mask & IFCAP_TXCSUM) != 0) {
+			ifp->if_capenable ^= IFCAP_TXCSUM;
+			if ((ifp->if_capenable & IFCAP_TXCSUM) != 0)
+				ifp->if_hwassist |= EMAC_CSUM_FEATURES;
+			else
+				ifp->if_hwassist &= ~EMAC_CSUM_FEATURES;
+		}
+		if ((mask & IFCAP_TXCSUM_IPV6) != 0) {
+			ifp->if_capenable ^= IFCAP_TXCSUM_IPV6;
+			if ((ifp->if_capenable & IFCAP_TXCSUM_IPV6) != 0)
+				ifp->if_hwassist |= EMAC_CSUM6_FEATURES;
+			else
+				ifp->if_hwassist &= ~EMAC_CSUM6_FEATURES;
+		}
+		if ((mask & IFCAP_LRO) != 0)
+			ifp->if_capenable ^= IFCAP_LRO;
+		if ((mask & IFCAP_TSO4) != 0) {
+			ifp->if_capenable ^= IFCAP_TSO4;
+			if ((ifp->if_capenable & IFCAP_TSO4) != 0)
+				ifp->if_hwassist |= CSUM_IP_TSO;
+			else
+				ifp->if_hwassist &= ~CSUM_IP_TSO;
+		}
+		if ((mask & IFCAP_TSO6) != 0) {
+			ifp->if_capenable ^= IFCAP_TSO6;
+			if ((ifp->if_capenable & IFCAP_TSO6) != 0)
+				ifp->if_hwassist |= CSUM_IP6_TSO;
+			else
+				ifp->if_hwassist &= ~CSUM_IP6_TSO;
+		}
 		break;
 	case SIOCGIFMEDIA:
 	case SIOCSIFMEDIA:
 		mii = device_get_softc(sc->emac_miibus);
 		error = ifmedia_ioctl(ifp, ifr, &mii->mii_media, command);
 		break;
+	case SIOCGDRVSPEC:
+	case SIOCSDRVSPEC:
+		error = emac_drvspec(sc, command, (struct ifdrv *)data);
+		break;
 	default:
 		error = ether_ioctl(ifp, command, data);
 		break;
@@ -743,6 +2861,112 @@ emac_ioctl(struct ifnet *ifp, u_long command, caddr_t data)
 	return (error);
 }
 
+static int
+emac_drvspec(struct emac_softc *sc, u_long command, struct ifdrv *ifd)
+{
+	struct emac_cls_rule rules[EMAC_CLS_MAXRULES];
+	struct emac_saf saf;
+	struct bpf_insn *oprog, *prog;
+	int error, i, n;
+
+	switch (ifd->ifd_cmd) {
+	case EMAC_CLS_GET_RULES:
+		if (command != SIOCGDRVSPEC)
+			return (EINVAL);
+		EMAC_RX_LOCK(sc);
+		n = sc->emac_cls_nrules;
+		bcopy(sc->emac_cls_rules, rules, n * sizeof(rules[0]));
+		EMAC_RX_UNLOCK(sc);
+		error = copyout(rules, ifd->ifd_data,
+		    min(ifd->ifd_len, n * sizeof(rules[0])));
+		ifd->ifd_len = n * sizeof(rules[0]);
+		return (error);
+	case EMAC_CLS_SET_RULES:
+		if (command != SIOCSDRVSPEC)
+			return (EINVAL);
+		if (ifd->ifd_len > sizeof(rules) ||
+		    ifd->ifd_len % sizeof(rules[0]) != 0)
+			return (EINVAL);
+		n = ifd->ifd_len / sizeof(rules[0]);
+		error = copyin(ifd->ifd_data, rules, ifd->ifd_len);
+		if (error != 0)
+			return (error);
+		for (i = 0; i < n; i++) {
+			if (rules[i].ecr_action != EMAC_CLS_PASS &&
+			    rules[i].ecr_action != EMAC_CLS_DROP)
+				return (EINVAL);
+			rules[i].ecr_hits = 0;
+		}
+		EMAC_RX_LOCK(sc);
+		bcopy(rules, sc->emac_cls_rules, n * sizeof(rules[0]));
+		sc->emac_cls_nrules = n;
+		EMAC_RX_UNLOCK(sc);
+		return (0);
+	case EMAC_CLS_SET_PROG:
+		if (command != SIOCSDRVSPEC)
+			return (EINVAL);
+		if (ifd->ifd_len > EMAC_CLS_MAXINSNS * sizeof(*prog) ||
+		    ifd->ifd_len % sizeof(*prog) != 0)
+			return (EINVAL);
+		n = ifd->ifd_len / sizeof(*prog);
+		prog = NULL;
+		if (n != 0) {
+			prog = malloc(ifd->ifd_len, M_DEVBUF, M_WAITOK);
+			error = copyin(ifd->ifd_data, prog, ifd->ifd_len);
+			if (error == 0 && (!bpf_validate(prog, n) ||
+			    !emac_cls_progok(prog, n)))
+				error = EINVAL;
+			if (error != 0) {
+				free(prog, M_DEVBUF);
+				return (error);
+			}
+		}
+		EMAC_RX_LOCK(sc);
+		oprog = sc->emac_cls_prog;
+		sc->emac_cls_prog = prog;
+		EMAC_RX_UNLOCK(sc);
+		free(oprog, M_DEVBUF);
+		return (0);
+	case EMAC_SAF_GET:
+		if (command != SIOCGDRVSPEC)
+			return (EINVAL);
+		bzero(&saf, sizeof(saf));
+		EMAC_RX_LOCK(sc);
+		saf.es_mode = sc->emac_saf_mode;
+		saf.es_count = sc->emac_saf_count;
+		bcopy(sc->emac_saf_addr, saf.es_addr, sizeof(saf.es_addr));
+		EMAC_RX_UNLOCK(sc);
+		error = copyout(&saf, ifd->ifd_data,
+		    min(ifd->ifd_len, sizeof(saf)));
+		ifd->ifd_len = sizeof(saf);
+		return (error);
+	case EMAC_SAF_SET:
+		if (command != SIOCSDRVSPEC)
+			return (EINVAL);
+		if (ifd->ifd_len != sizeof(saf))
+			return (EINVAL);
+		error = copyin(ifd->ifd_data, &saf, sizeof(saf));
+		if (error != 0)
+			return (error);
+		if (saf.es_mode > EMAC_SAF_DENY ||
+		    saf.es_count > EMAC_SAF_MAXADDRS)
+			return (EINVAL);
+		/* An empty list filters nothing. */
+		if (saf.es_count == 0)
+			saf.es_mode = EMAC_SAF_OFF;
+		EMAC_RX_LOCK(sc);
+		sc->emac_saf_mode = saf.es_mode;
+		sc->emac_saf_count = saf.es_count;
+		bcopy(saf.es_addr, sc->emac_saf_addr, sizeof(saf.es_addr));
+		if ((sc->emac_ifp->if_drv_flags & IFF_DRV_RUNNING) != 0)
+			emac_set_rx_mode(sc);
+		EMAC_RX_UNLOCK(sc);
+		return (0);
+	default:
+		return (EINVAL);
+	}
+}
+
 static int
 emac_probe(device_t dev)
 {
@@ -760,19 +2984,49 @@ emac_detach(device_t dev)
 	struct emac_softc *sc;
 
 	sc = device_get_softc(dev);
-	sc->emac_ifp->if_drv_flags &= ~IFF_DRV_RUNNING;
+	if (sc->emac_ifp != NULL)
+		sc->emac_ifp->if_drv_flags &= ~IFF_DRV_RUNNING;
 	if (device_is_attached(dev)) {
+#ifdef DEVICE_POLLING
+		if (sc->emac_ifp->if_capenable & IFCAP_POLLING)
+			ether_poll_deregister(sc->emac_ifp);
+#endif
 		ether_ifdetach(sc->emac_ifp);
 		EMAC_LOCK(sc);
 		emac_stop_locked(sc);
 		EMAC_UNLOCK(sc);
 		callout_drain(&sc->emac_tick_ch);
+		callout_drain(&sc->emac_holdoff_ch);
+		if (sc->emac_phy_int_pin >= 0)
+			a10_gpio_eint_teardown(sc->emac_phy_int_pin);
+		taskqueue_drain(taskqueue_thread, &sc->emac_mii_task);
 	}
 
 	if (sc->emac_intrhand != NULL)
 		bus_teardown_intr(sc->emac_dev, sc->emac_irq,
 		    sc->emac_intrhand);
 
+	/* DMA completions enqueue the tasks, release the channels first. */
+	emac_rxdma_detach(sc);
+	emac_txdma_detach(sc);
+
+	if (sc->emac_tq != NULL) {
+		taskqueue_drain(sc->emac_tq, &sc->emac_int_task);
+		taskqueue_drain(sc->emac_tq, &sc->emac_tx_task);
+		taskqueue_free(sc->emac_tq);
+	}
+
+	/* Nothing can reach the ring once the tasks are gone. */
+	if (sc->emac_br != NULL)
+		buf_ring_free(sc->emac_br, M_DEVBUF);
+
+	emac_rx_cache_free(sc);
+#if defined(INET) || defined(INET6)
+	if (sc->emac_lro.ifp != NULL)
+		tcp_lro_free(&sc->emac_lro);
+#endif
+	free(sc->emac_cls_prog, M_DEVBUF);
+
 	if (sc->emac_miibus != NULL) {
 		device_delete_child(sc->emac_dev, sc->emac_miibus);
 		bus_generic_detach(sc->emac_dev);
@@ -784,11 +3038,18 @@ emac_detach(device_t dev)
 	if (sc->emac_irq != NULL)
 		bus_release_resource(dev, SYS_RES_IRQ, 0, sc->emac_irq);
 
-	if (sc->emac_ifp != NULL)
+	if (sc->emac_ifp != NULL) {
+#ifdef DEV_NETMAP
+		netmap_detach(sc->emac_ifp);
+#endif
 		if_free(sc->emac_ifp);
+	}
 
-	if (mtx_initialized(&sc->emac_mtx))
-		mtx_destroy(&sc->emac_mtx);
+	if (mtx_initialized(&sc->emac_tx_mtx))
+		mtx_destroy(&sc->emac_tx_mtx);
+	if (mtx_initialized(&sc->emac_rx_mtx))
+		mtx_destroy(&sc->emac_rx_mtx);
+	sx_destroy(&sc->emac_mii_lock);
 
 	return (0);
 }
@@ -841,16 +3102,38 @@ emac_attach(device_t dev)
 {
 	struct emac_softc *sc;
 	struct ifnet *ifp;
-	int error, rid;
+	int error, rid, rx_dma, tx_dma, task_cpu;
 	uint8_t eaddr[ETHER_ADDR_LEN];
 
 	sc = device_get_softc(dev);
 	sc->emac_dev = dev;
 
 	error = 0;
-	mtx_init(&sc->emac_mtx, device_get_nameunit(dev), MTX_NETWORK_LOCK,
-	    MTX_DEF);
-	callout_init_mtx(&sc->emac_tick_ch, &sc->emac_mtx, 0);
+	mtx_init(&sc->emac_rx_mtx, "emac rx", MTX_NETWORK_LOCK, MTX_DEF);
+	mtx_init(&sc->emac_tx_mtx, "emac tx", MTX_NETWORK_LOCK, MTX_DEF);
+	sx_init(&sc->emac_mii_lock, "emac mii");
+	sc->emac_phy_int_pin = -1;
+	callout_init_mtx(&sc->emac_tick_ch, &sc->emac_rx_mtx, 0);
+	callout_init(&sc->emac_holdoff_ch, 1);
+	sc->emac_rx_clcache.rc_cluster = 1;
+	sc->emac_br = buf_ring_alloc(EMAC_TX_RING_SIZE, M_DEVBUF, M_WAITOK,
+	    &sc->emac_tx_mtx);
+	TASK_INIT(&sc->emac_tx_task, 0, emac_tx_task, sc);
+	TASK_INIT(&sc->emac_int_task, 0, emac_int_task, sc);
+	TASK_INIT(&sc->emac_mii_task, 0, emac_mii_task, sc);
+	sc->emac_tq = taskqueue_create_fast("emac_taskq", M_WAITOK,
+	    taskqueue_thread_enqueue, &sc->emac_tq);
+
+	/* Optionally bind the network processing to a given CPU. */
+	task_cpu = -1;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "task_cpu", &task_cpu);
+	if (task_cpu >= 0 && task_cpu <= mp_maxid && !CPU_ABSENT(task_cpu))
+		taskqueue_start_threads_pinned(&sc->emac_tq, 1, PI_NET,
+		    task_cpu, "%s taskq", device_get_nameunit(dev));
+	else
+		taskqueue_start_threads(&sc->emac_tq, 1, PI_NET, "%s taskq",
+		    device_get_nameunit(dev));
 
 	rid = 0;
 	sc->emac_res = bus_alloc_resource_any(dev, SYS_RES_MEMORY, &rid,
@@ -890,6 +3173,22 @@ emac_attach(device_t dev)
 			sc->emac_rx_process_limit = EMAC_PROC_DEFAULT;
 		}
 	}
+	emac_add_sysctls(sc);
+	/*
+	 * Move frames through the DMA controller unless told otherwise,
+	 * programmed I/O is kept as a fallback.
+	 */
+	rx_dma = 1;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "rx_dma", &rx_dma);
+	if (rx_dma != 0 && emac_rxdma_attach(sc) != 0)
+		device_printf(dev, "no DMA channel, using PIO receive\n");
+	tx_dma = 1;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "tx_dma", &tx_dma);
+	if (tx_dma != 0 && emac_txdma_attach(sc) != 0)
+		device_printf(dev, "no DMA channel, using PIO transmit\n");
+
 	/* Setup EMAC */
 	emac_sys_setup();
 	emac_reset(sc);
@@ -903,32 +3202,60 @@ emac_attach(device_t dev)
 	ifp->if_softc = sc;
 
 	/* Setup MII */
+	EMAC_MII_LOCK(sc);
 	error = mii_attach(dev, &sc->emac_miibus, ifp, emac_ifmedia_upd,
 	    emac_ifmedia_sts, BMSR_DEFCAPMASK, MII_PHY_ANY, MII_OFFSET_ANY, 0);
+	EMAC_MII_UNLOCK(sc);
 	if (error != 0) {
 		device_printf(dev, "PHY probe failed\n");
 		goto fail;
 	}
+	emac_phy_intr_attach(sc);
 
 	if_initname(ifp, device_get_name(dev), device_get_unit(dev));
 	ifp->if_flags = IFF_BROADCAST | IFF_SIMPLEX | IFF_MULTICAST;
-	ifp->if_start = emac_start;
+	ifp->if_transmit = emac_transmit;
+	ifp->if_qflush = emac_qflush;
 	ifp->if_ioctl = emac_ioctl;
 	ifp->if_init = emac_init;
-	IFQ_SET_MAXLEN(&ifp->if_snd, IFQ_MAXLEN);
 
 	/* Get MAC address */
 	emac_get_hwaddr(sc, eaddr);
 	ether_ifattach(ifp, eaddr);
+#ifdef DEV_NETMAP
+	emac_netmap_attach(sc);
+#endif
 
 	/* VLAN capability setup. */
 	ifp->if_capabilities |= IFCAP_VLAN_MTU;
+	/*
+	 * There is no checksum engine, but receive checksums are verified
+	 * while draining the FIFO and transmit checksums are filled in
+	 * right before the frame is written to it.
+	 */
+	ifp->if_capabilities |= IFCAP_RXCSUM | IFCAP_RXCSUM_IPV6;
+	ifp->if_capabilities |= IFCAP_TXCSUM | IFCAP_TXCSUM_IPV6;
+	/* TSO is done in software, one FIFO channel fill per frame. */
+	ifp->if_capabilities |= IFCAP_TSO4 | IFCAP_TSO6;
+#if defined(INET) || defined(INET6)
+	if (tcp_lro_init(&sc->emac_lro) == 0) {
+		sc->emac_lro.ifp = ifp;
+		ifp->if_capabilities |= IFCAP_LRO;
+	} else
+		device_printf(dev, "could not set up LRO\n");
+#endif
 	ifp->if_capenable = ifp->if_capabilities;
+	ifp->if_hwassist = EMAC_CSUM_FEATURES | EMAC_CSUM6_FEATURES |
+	    CSUM_TSO;
+#ifdef DEVICE_POLLING
+	/* Polling is available but off by default. */
+	ifp->if_capabilities |= IFCAP_POLLING;
+#endif
 	/* Tell the upper layer we support VLAN over-sized frames. */
 	ifp->if_hdrlen = sizeof(struct ether_vlan_header);
 
 	error = bus_setup_intr(dev, sc->emac_irq, INTR_TYPE_NET | INTR_MPSAFE,
-	    NULL, emac_intr, sc, &sc->emac_intrhand);
+	    emac_intr, NULL, sc, &sc->emac_intrhand);
 	if (error != 0) {
 		device_printf(dev, "could not set up interrupt handler.\n");
 		ether_ifdetach(ifp);
@@ -944,10 +3271,18 @@ fail:
 static boolean_t
 emac_miibus_iowait(struct emac_softc *sc)
 {
-	uint32_t timeout;
+	int timeout;
 
-	for (timeout = 100; timeout != 0; --timeout) {
-		DELAY(100);
+	EMAC_MII_ASSERT_LOCKED(sc);
+
+	for (timeout = EMAC_MII_SPIN; timeout != 0; --timeout) {
+		if ((EMAC_READ_REG(sc, EMAC_MAC_MIND) & 0x1) == 0)
+			return (true);
+		DELAY(1);
+	}
+	/* Slow PHY, give the CPU away while waiting. */
+	for (timeout = EMAC_MII_SLEEPS; timeout != 0; --timeout) {
+		pause_sbt("emacmii", SBT_1MS, 0, 0);
 		if ((EMAC_READ_REG(sc, EMAC_MAC_MIND) & 0x1) == 0)
 			return (true);
 	}
@@ -1017,9 +3352,15 @@ emac_miibus_statchg(device_t dev)
 
 	mii = device_get_softc(sc->emac_miibus);
 	ifp = sc->emac_ifp;
-	if (mii == NULL || ifp == NULL ||
-	    (ifp->if_drv_flags & IFF_DRV_RUNNING) == 0)
+	if (mii == NULL || ifp == NULL)
+		return;
+
+	/* Called from the MII code, which runs without the datapath locks. */
+	EMAC_LOCK(sc);
+	if ((ifp->if_drv_flags & IFF_DRV_RUNNING) == 0) {
+		EMAC_UNLOCK(sc);
 		return;
+	}
 
 	sc->emac_link = 0;
 	if ((mii->mii_media_status & (IFM_ACTIVE | IFM_AVALID)) ==
@@ -1054,6 +3395,11 @@ emac_miibus_statchg(device_t dev)
 		reg_val &= ~(EMAC_CTL_RST | EMAC_CTL_TX_EN | EMAC_CTL_RX_EN);
 		EMAC_WRITE_REG(sc, EMAC_CTL, reg_val);
 	}
+
+	/* Frames may have queued up while the link was down. */
+	if (sc->emac_link != 0 && emac_tx_pending(sc))
+		taskqueue_enqueue(sc->emac_tq, &sc->emac_tx_task);
+	EMAC_UNLOCK(sc);
 }
 
 static int
@@ -1066,11 +3412,13 @@ emac_ifmedia_upd(struct ifnet *ifp)
 
 	sc = ifp->if_softc;
 	mii = device_get_softc(sc->emac_miibus);
-	EMAC_LOCK(sc);
+	EMAC_MII_LOCK(sc);
 	LIST_FOREACH(miisc, &mii->mii_phys, mii_list)
 		PHY_RESET(miisc);
+	/* The reset may have cleared the PHY interrupt enable. */
+	emac_phy_intr_enable(sc);
 	error = mii_mediachg(mii);
-	EMAC_UNLOCK(sc);
+	EMAC_MII_UNLOCK(sc);
 
 	return (error);
 }
@@ -1084,11 +3432,11 @@ emac_ifmedia_sts(struct ifnet *ifp, struct ifmediareq *ifmr)
 	sc = ifp->if_softc;
 	mii = device_get_softc(sc->emac_miibus);
 
-	EMAC_LOCK(sc);
+	EMAC_MII_LOCK(sc);
 	mii_pollstat(mii);
 	ifmr->ifm_active = mii->mii_media_active;
 	ifmr->ifm_status = mii->mii_media_status;
-	EMAC_UNLOCK(sc);
+	EMAC_MII_UNLOCK(sc);
 }
 
 static device_method_t emac_methods[] = {
@@ -1125,6 +3473,123 @@ DRIVER_MODULE(miibus, emac, miibus_driver, miibus_devclass, 0, 0);
 MODULE_DEPEND(emac, miibus, 1, 1, 1);
 MODULE_DEPEND(emac, ether, 1, 1, 1);
 
+static void
+emac_add_sysctls(struct emac_softc *sc)
+{
+	struct sysctl_ctx_list *ctx;
+	struct sysctl_oid_list *child, *parent;
+	struct sysctl_oid *tree;
+	device_t dev;
+
+	dev = sc->emac_dev;
+	ctx = device_get_sysctl_ctx(dev);
+	child = SYSCTL_CHILDREN(device_get_sysctl_tree(dev));
+
+	sc->emac_holdoff_us = EMAC_HOLDOFF_US_DEFAULT;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "int_holdoff_us", &sc->emac_holdoff_us);
+	if (sc->emac_holdoff_us < 0 ||
+	    sc->emac_holdoff_us > EMAC_HOLDOFF_US_MAX)
+		sc->emac_holdoff_us = EMAC_HOLDOFF_US_DEFAULT;
+	sc->emac_holdoff_frames = EMAC_HOLDOFF_FRAMES_DEFAULT;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "int_holdoff_frames", &sc->emac_holdoff_frames);
+	if (sc->emac_holdoff_frames < EMAC_HOLDOFF_FRAMES_MIN ||
+	    sc->emac_holdoff_frames > EMAC_HOLDOFF_FRAMES_MAX)
+		sc->emac_holdoff_frames = EMAC_HOLDOFF_FRAMES_DEFAULT;
+
+	sc->emac_rx_pack_max = 0;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "rx_pack_max", &sc->emac_rx_pack_max);
+	if (sc->emac_rx_pack_max < 0 ||
+	    sc->emac_rx_pack_max > EMAC_RX_PACK_MAX)
+		sc->emac_rx_pack_max = 0;
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "rx_pack_max",
+	    CTLTYPE_INT | CTLFLAG_RW, &sc->emac_rx_pack_max, 0,
+	    sysctl_hw_emac_rx_pack_max, "I",
+	    "max. frame size packed into a shared page in bursts (0 disables)");
+
+	sc->emac_fc_hiwat = 0;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "fc_hiwat", &sc->emac_fc_hiwat);
+	if (sc->emac_fc_hiwat < 0 || sc->emac_fc_hiwat > EMAC_FC_WAT_MAX)
+		sc->emac_fc_hiwat = 0;
+	sc->emac_fc_lowat = 0;
+	resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "fc_lowat", &sc->emac_fc_lowat);
+	if (sc->emac_fc_lowat < 0 || sc->emac_fc_lowat > EMAC_FC_WAT_MAX ||
+	    sc->emac_fc_lowat >= sc->emac_fc_hiwat)
+		sc->emac_fc_lowat = 0;
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "fc_hiwat",
+	    CTLTYPE_INT | CTLFLAG_RW, sc, 0, sysctl_hw_emac_fc_hiwat, "I",
+	    "frames queued in the RX FIFO to start flow control (0 disables)");
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "fc_lowat",
+	    CTLTYPE_INT | CTLFLAG_RW, sc, 0, sysctl_hw_emac_fc_lowat, "I",
+	    "frames queued in the RX FIFO to release flow control");
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "int_holdoff_us",
+	    CTLTYPE_INT | CTLFLAG_RW, &sc->emac_holdoff_us, 0,
+	    sysctl_hw_emac_holdoff_us, "I",
+	    "interrupt holdoff after a receive burst, in us (0 disables)");
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "int_holdoff_frames",
+	    CTLTYPE_INT | CTLFLAG_RW, &sc->emac_holdoff_frames, 0,
+	    sysctl_hw_emac_holdoff_frames, "I",
+	    "min. frames in a receive burst to start a holdoff");
+
+	tree = SYSCTL_ADD_NODE(ctx, child, OID_AUTO, "stats", CTLFLAG_RD,
+	    NULL, "EMAC statistics");
+	parent = SYSCTL_CHILDREN(tree);
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "intrs", CTLFLAG_RD,
+	    &sc->emac_stat_intrs, "interrupts taken");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "holdoffs", CTLFLAG_RD,
+	    &sc->emac_stat_holdoffs, "interrupt holdoffs started");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_frames", CTLFLAG_RD,
+	    &sc->emac_stat_rx_frames, "frames received by the task");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_cache_empty", CTLFLAG_RD,
+	    &sc->emac_stat_rx_cache_empty,
+	    "receive mbuf cache ran dry within a batch");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_refill_fail", CTLFLAG_RD,
+	    &sc->emac_stat_rx_refill_fail,
+	    "receive mbuf cache refill failures");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_nombuf", CTLFLAG_RD,
+	    &sc->emac_stat_rx_nombuf, "frames dropped for lack of mbufs");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_small", CTLFLAG_RD,
+	    &sc->emac_stat_rx_small, "frames received into a plain mbuf");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_cluster", CTLFLAG_RD,
+	    &sc->emac_stat_rx_cluster, "frames received into a cluster");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_packed", CTLFLAG_RD,
+	    &sc->emac_stat_rx_packed, "frames received into a shared page");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_pages", CTLFLAG_RD,
+	    &sc->emac_stat_rx_pages, "shared receive pages allocated");
+#if defined(INET) || defined(INET6)
+	SYSCTL_ADD_UINT(ctx, parent, OID_AUTO, "lro_queued", CTLFLAG_RD,
+	    &sc->emac_lro.lro_queued, 0, "segments merged by LRO");
+	SYSCTL_ADD_UINT(ctx, parent, OID_AUTO, "lro_flushed", CTLFLAG_RD,
+	    &sc->emac_lro.lro_flushed, 0, "LRO flows passed to the stack");
+#endif
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "cls_drops", CTLFLAG_RD,
+	    &sc->emac_stat_cls_drops, "frames dropped by the classifier");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "saf_drops", CTLFLAG_RD,
+	    &sc->emac_stat_saf_drops,
+	    "frames dropped by the software source address filter");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "pause_tx", CTLFLAG_RD,
+	    &sc->emac_stat_pause_tx, "times flow control was asserted");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "pause_rx", CTLFLAG_RD,
+	    &sc->emac_stat_pause_rx, "pause frames received");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "phy_intrs", CTLFLAG_RD,
+	    &sc->emac_stat_phy_intrs, "PHY link interrupts");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "rx_monitor", CTLFLAG_RD,
+	    &sc->emac_stat_rx_monitor, "frames captured in monitor mode");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "tso", CTLFLAG_RD,
+	    &sc->emac_stat_tso, "TSO super-segments taken from the stack");
+	SYSCTL_ADD_ULONG(ctx, parent, OID_AUTO, "tso_segs", CTLFLAG_RD,
+	    &sc->emac_stat_tso_segs, "frames cut from TSO super-segments");
+	SYSCTL_ADD_PROC(ctx, parent, OID_AUTO, "frames_per_intr",
+	    CTLTYPE_UINT | CTLFLAG_RD, sc, 0, sysctl_hw_emac_coalesce, "IU",
+	    "received frames per interrupt, x100");
+}
+
 static int
 sysctl_int_range(SYSCTL_HANDLER_ARGS, int low, int high)
 {
@@ -1150,3 +3615,99 @@ sysctl_hw_emac_proc_limit(SYSCTL_HANDLER_ARGS)
 	return (sysctl_int_range(oidp, arg1, arg2, req,
 	    EMAC_PROC_MIN, EMAC_PROC_MAX));
 }
+
+static int
+sysctl_hw_emac_holdoff_us(SYSCTL_HANDLER_ARGS)
+{
+
+	return (sysctl_int_range(oidp, arg1, arg2, req,
+	    0, EMAC_HOLDOFF_US_MAX));
+}
+
+static int
+sysctl_hw_emac_holdoff_frames(SYSCTL_HANDLER_ARGS)
+{
+
+	return (sysctl_int_range(oidp, arg1, arg2, req,
+	    EMAC_HOLDOFF_FRAMES_MIN, EMAC_HOLDOFF_FRAMES_MAX));
+}
+
+static int
+sysctl_hw_emac_coalesce(SYSCTL_HANDLER_ARGS)
+{
+	struct emac_softc *sc;
+	u_int ratio;
+
+	sc = (struct emac_softc *)arg1;
+	ratio = 0;
+	if (sc->emac_stat_intrs != 0)
+		ratio = (uint64_t)sc->emac_stat_rx_frames * 100 /
+		    sc->emac_stat_intrs;
+
+	return (sysctl_handle_int(oidp, &ratio, 0, req));
+}
+
+static int
+sysctl_hw_emac_rx_pack_max(SYSCTL_HANDLER_ARGS)
+{
+
+	return (sysctl_int_range(oidp, arg1, arg2, req,
+	    0, EMAC_RX_PACK_MAX));
+}
+
+static int
+sysctl_hw_emac_fc_hiwat(SYSCTL_HANDLER_ARGS)
+{
+	struct emac_softc *sc;
+	uint32_t reg_val;
+	int error, value;
+
+	sc = (struct emac_softc *)arg1;
+	value = sc->emac_fc_hiwat;
+	error = sysctl_int_range(oidp, &value, arg2, req,
+	    0, EMAC_FC_WAT_MAX);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	EMAC_RX_LOCK(sc);
+	if (value != 0 && value <= sc->emac_fc_lowat) {
+		EMAC_RX_UNLOCK(sc);
+		return (EINVAL);
+	}
+	sc->emac_fc_hiwat = value;
+	/* Control frames are only passed up while this is on. */
+	if (sc->emac_fc_hiwat == 0 && sc->emac_fc_on != 0) {
+		sc->emac_fc_on = 0;
+		reg_val = EMAC_READ_REG(sc, EMAC_TX_FLOW);
+		EMAC_WRITE_REG(sc, EMAC_TX_FLOW, reg_val & ~EMAC_TX_FLOW_EN);
+	}
+	if ((sc->emac_ifp->if_drv_flags & IFF_DRV_RUNNING) != 0)
+		emac_set_rx_mode(sc);
+	EMAC_RX_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+sysctl_hw_emac_fc_lowat(SYSCTL_HANDLER_ARGS)
+{
+	struct emac_softc *sc;
+	int error, value;
+
+	sc = (struct emac_softc *)arg1;
+	value = sc->emac_fc_lowat;
+	error = sysctl_int_range(oidp, &value, arg2, req,
+	    0, EMAC_FC_WAT_MAX);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	/* The low watermark has to stay below the high one. */
+	EMAC_RX_LOCK(sc);
+	if (sc->emac_fc_hiwat != 0 && value >= sc->emac_fc_hiwat)
+		error = EINVAL;
+	else
+		sc->emac_fc_lowat = value;
+	EMAC_RX_UNLOCK(sc);
+
+	return (error);
+}
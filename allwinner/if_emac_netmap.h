@@ -0,0 +1,227 @@
+/*-
+ * Copyright (c) 2015 The FreeBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * netmap(4) support for the A10/A20 EMAC, included from if_emac.c.
+ *
+ * The controller has no descriptor rings: frames are moved through the
+ * FIFOs by the CPU.  The single netmap ring pair therefore copies
+ * straight between the netmap buffers and the FIFO data registers,
+ * skipping mbufs and the rest of the stack, and the TX ring is drained
+ * into whichever of the two TX FIFO channels is idle.
+ */
+
+#include <net/netmap.h>
+#include <sys/selinfo.h>
+#include <vm/vm.h>
+#include <vm/pmap.h>
+#include <dev/netmap/netmap_kern.h>
+
+/*
+ * Register/unregister.  We are already under the netmap lock.
+ */
+static int
+emac_netmap_reg(struct netmap_adapter *na, int onoff)
+{
+	struct ifnet *ifp;
+	struct emac_softc *sc;
+
+	ifp = na->ifp;
+	sc = ifp->if_softc;
+
+	EMAC_LOCK(sc);
+	emac_stop_locked(sc);
+	if (onoff)
+		nm_set_native_flags(na);
+	else
+		nm_clear_native_flags(na);
+	emac_init_locked(sc);
+	EMAC_UNLOCK(sc);
+
+	return ((ifp->if_drv_flags & IFF_DRV_RUNNING) ? 0 : 1);
+}
+
+/*
+ * Reconcile kernel and user view of the transmit ring.
+ */
+static int
+emac_netmap_txsync(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na;
+	struct netmap_ring *ring;
+	struct netmap_slot *slot;
+	struct emac_softc *sc;
+	struct emac_txfifo tf;
+	void *addr;
+	u_int head, lim, len, nm_i;
+	uint32_t fifo;
+
+	na = kring->na;
+	ring = kring->ring;
+	sc = na->ifp->if_softc;
+	lim = kring->nkr_num_slots - 1;
+	head = kring->rhead;
+
+	EMAC_TX_LOCK(sc);
+	/*
+	 * Copy new slots into idle FIFO channels.  Once written the
+	 * data lives in the FIFO, so slots are returned right away and
+	 * a full FIFO just leaves the rest for the next call, which the
+	 * TX completion interrupt triggers.
+	 */
+	nm_i = kring->nr_hwcur;
+	while (nm_i != head && sc->emac_link != 0 &&
+	    sc->emac_fifo_mask != EMAC_TX_FIFO_ALL &&
+	    sc->emac_tx_dma_m == NULL) {
+		slot = &ring->slot[nm_i];
+		len = slot->len;
+		addr = NMB(na, slot);
+
+		NM_CHECK_ADDR_LEN(na, addr, len);
+		slot->flags &= ~(NS_REPORT | NS_BUF_CHANGED);
+		nm_i = nm_next(nm_i, lim);
+		if (len == 0)
+			continue;
+		/* NM_CHECK_ADDR_LEN only clamps to the buffer size. */
+		if (len > EMAC_MAC_MFL - ETHER_CRC_LEN) {
+			if_inc_counter(na->ifp, IFCOUNTER_OERRORS, 1);
+			continue;
+		}
+
+		/* Select channel */
+		if (sc->emac_fifo_mask & EMAC_TX_FIFO0)
+			fifo = 1;
+		else
+			fifo = 0;
+		sc->emac_fifo_mask |= (1 << fifo);
+		EMAC_WRITE_REG(sc, EMAC_TX_INS, fifo);
+
+		tf.tf_carry = 0;
+		tf.tf_shift = 0;
+		emac_txfifo_put(sc, &tf, addr, len);
+		emac_txfifo_flush(sc, &tf);
+		emac_txfifo_send(sc, fifo, len);
+	}
+	kring->nr_hwcur = nm_i;
+	kring->nr_hwtail = nm_prev(nm_i, lim);
+	EMAC_TX_UNLOCK(sc);
+
+	nm_txsync_finalize(kring);
+
+	return (0);
+}
+
+/*
+ * Reconcile kernel and user view of the receive ring.
+ */
+static int
+emac_netmap_rxsync(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na;
+	struct netmap_ring *ring;
+	struct netmap_slot *slot;
+	struct emac_softc *sc;
+	uint32_t rxcount;
+	u_int head, lim, nm_i;
+	uint16_t slot_flags;
+	int error, force_update, len, n;
+
+	na = kring->na;
+	ring = kring->ring;
+	sc = na->ifp->if_softc;
+	lim = kring->nkr_num_slots - 1;
+	head = nm_rxsync_prologue(kring);
+	if (head > lim)
+		return (netmap_ring_reinit(kring));
+
+	force_update = (flags & NAF_FORCE_READ) ||
+	    (kring->nr_kflags & NKR_PENDINTR);
+
+	EMAC_RX_LOCK(sc);
+	/*
+	 * Import newly received frames.  Only read a header once there
+	 * is a free slot to copy the frame into, the rest stay in the
+	 * FIFO until the next call.
+	 */
+	if ((netmap_no_pendintr || force_update) &&
+	    sc->emac_rx_dma_m == NULL) {
+		slot_flags = kring->nkr_slot_flags;
+		nm_i = kring->nr_hwtail;
+		n = 0;
+		while (nm_next(nm_i, lim) != kring->nr_hwcur) {
+			error = emac_rxhdr(sc, &rxcount, &len);
+			if (error == EINVAL)
+				continue;
+			if (error != 0)
+				break;
+
+			slot = &ring->slot[nm_i];
+			if (len > NETMAP_BUF_SIZE(na)) {
+				if_inc_counter(na->ifp, IFCOUNTER_IQDROPS, 1);
+				emac_rxdiscard(sc, len);
+				continue;
+			}
+			bus_space_read_multi_4(sc->emac_tag, sc->emac_handle,
+			    EMAC_RX_IO_DATA, (uint32_t *)NMB(na, slot),
+			    roundup2(len, 4) / 4);
+			slot->len = len;
+			slot->flags = slot_flags;
+			nm_i = nm_next(nm_i, lim);
+			n++;
+		}
+		if (n != 0) {
+			if_inc_counter(na->ifp, IFCOUNTER_IPACKETS, n);
+			kring->nr_hwtail = nm_i;
+		}
+		kring->nr_kflags &= ~NKR_PENDINTR;
+	}
+
+	/* Slots handed back by userspace need no work here. */
+	kring->nr_hwcur = head;
+	EMAC_RX_UNLOCK(sc);
+
+	nm_rxsync_finalize(kring);
+
+	return (0);
+}
+
+static void
+emac_netmap_attach(struct emac_softc *sc)
+{
+	struct netmap_adapter na;
+
+	bzero(&na, sizeof(na));
+	na.ifp = sc->emac_ifp;
+	na.num_tx_desc = EMAC_TX_RING_SIZE;
+	na.num_rx_desc = EMAC_TX_RING_SIZE;
+	na.nm_txsync = emac_netmap_txsync;
+	na.nm_rxsync = emac_netmap_rxsync;
+	na.nm_register = emac_netmap_reg;
+	na.num_tx_rings = na.num_rx_rings = 1;
+	netmap_attach(&na);
+}
@@ -62,8 +62,11 @@
 #define	EMAC_INT_CTL		0x54
 #define	EMAC_INT_STA		0x58
 #define	EMAC_INT_STA_TX		(0x01 | 0x02)
+#define	EMAC_TX_FIFO0		(1 << 0)
+#define	EMAC_TX_FIFO1		(1 << 1)
+#define	EMAC_TX_FIFO_ALL	(EMAC_TX_FIFO0 | EMAC_TX_FIFO1)
 #define	EMAC_INT_STA_RX		0x100
-#define	EMAC_INT_EN		(0xf << 0) | (1 << 8)
+#define	EMAC_INT_EN		((0xf << 0) | (1 << 8))
 
 #define	EMAC_MAC_CTL0		0x5C
 #define	EMAC_MAC_CTL1		0x60
@@ -111,14 +114,19 @@
 /* Aborted frame enable */
 #define	EMAC_TX_AB_M		(1 << 0)
 
+/* Assert flow control: pause frames in full, back pressure in half duplex */
+#define	EMAC_TX_FLOW_EN		(1 << 0)
+
 /* 0: Enable CPU mode for TX, 1: DMA */
 #define	EMAC_TX_TM		~(1 << 1)
+#define	EMAC_TX_DMA		(1 << 1)
 
 /* 0: DRQ asserted, 1: DRQ automatically */
 #define	EMAC_RX_DRQ_MODE	(1 << 1)
 
 /* 0: Enable CPU mode for RX, 1: DMA */
 #define	EMAC_RX_TM		~(1 << 2)
+#define	EMAC_RX_DMA		(1 << 2)
 
 /* Pass all Frames */
 #define	EMAC_RX_PA		(1 << 4)
@@ -232,8 +240,81 @@
 #define	EMAC_PROC_MAX		255
 #define	EMAC_PROC_DEFAULT	64
 
-#define	EMAC_LOCK(cs)		mtx_lock(&(sc)->emac_mtx)
-#define	EMAC_UNLOCK(cs)		mtx_unlock(&(sc)->emac_mtx)
-#define	EMAC_ASSERT_LOCKED(sc)	mtx_assert(&(sc)->emac_mtx, MA_OWNED);
+/* Interrupt holdoff, in microseconds and received frames */
+#define	EMAC_HOLDOFF_US_MAX	10000
+#define	EMAC_HOLDOFF_US_DEFAULT	0
+#define	EMAC_HOLDOFF_FRAMES_MIN	1
+#define	EMAC_HOLDOFF_FRAMES_MAX	EMAC_PROC_MAX
+#define	EMAC_HOLDOFF_FRAMES_DEFAULT	8
+
+/* Number of pre-allocated receive mbufs of each kind */
+#define	EMAC_RX_CACHE_SIZE	EMAC_PROC_DEFAULT
+
+/* Largest frame that may be packed into a shared receive page */
+#define	EMAC_RX_PACK_MAX	512
+
+/* Checksums filled in by the driver on transmit */
+#define	EMAC_CSUM_FEATURES	(CSUM_IP | CSUM_TCP | CSUM_UDP)
+#define	EMAC_CSUM6_FEATURES	(CSUM_TCP_IPV6 | CSUM_UDP_IPV6)
+
+/* Largest L2-L4 header the driver replicates for TSO */
+#define	EMAC_TSO_HDR_MAX	160
+
+/*
+ * An MDIO transfer takes about 30us: spin this many microseconds for
+ * it, then sleep a millisecond at a time up to EMAC_MII_SLEEPS times.
+ */
+#define	EMAC_MII_SPIN		50
+#define	EMAC_MII_SLEEPS		10
+
+/* Receive flow control watermarks, in frames waiting in the FIFO */
+#define	EMAC_FC_WAT_MAX		32
+
+/* Seconds between link polls when the PHY interrupt is wired up */
+#define	EMAC_MII_SLOW_TICKS	10
+
+/* Depth of the transmit buf_ring */
+#define	EMAC_TX_RING_SIZE	512
+
+/* Max. number of DMA segments per transmitted frame */
+#define	EMAC_TXDMA_NSEGS	8
+
+/* Frame head copied to a word-aligned buffer for the DRQ */
+#define	EMAC_TXDMA_BOUNCE	128
+
+#define	EMAC_RX_LOCK(sc)		mtx_lock(&(sc)->emac_rx_mtx)
+#define	EMAC_RX_UNLOCK(sc)		mtx_unlock(&(sc)->emac_rx_mtx)
+#define	EMAC_RX_ASSERT_LOCKED(sc)	mtx_assert(&(sc)->emac_rx_mtx, MA_OWNED)
+
+#define	EMAC_TX_LOCK(sc)		mtx_lock(&(sc)->emac_tx_mtx)
+#define	EMAC_TX_TRYLOCK(sc)		mtx_trylock(&(sc)->emac_tx_mtx)
+#define	EMAC_TX_UNLOCK(sc)		mtx_unlock(&(sc)->emac_tx_mtx)
+#define	EMAC_TX_ASSERT_LOCKED(sc)	mtx_assert(&(sc)->emac_tx_mtx, MA_OWNED)
+
+/*
+ * Paths that touch both FIFOs (init, stop, statchg) take the RX lock
+ * first and the TX lock second.
+ */
+#define	EMAC_LOCK(sc)		do {					\
+	EMAC_RX_LOCK(sc);						\
+	EMAC_TX_LOCK(sc);						\
+} while (0)
+#define	EMAC_UNLOCK(sc)		do {					\
+	EMAC_TX_UNLOCK(sc);						\
+	EMAC_RX_UNLOCK(sc);						\
+} while (0)
+#define	EMAC_ASSERT_LOCKED(sc)	do {					\
+	EMAC_RX_ASSERT_LOCKED(sc);					\
+	EMAC_TX_ASSERT_LOCKED(sc);					\
+} while (0)
+
+/*
+ * PHY access sleeps, so it is serialized by its own lock and never done
+ * with the datapath locks held.  It may be taken before them.
+ */
+#define	EMAC_MII_LOCK(sc)		sx_xlock(&(sc)->emac_mii_lock)
+#define	EMAC_MII_UNLOCK(sc)		sx_xunlock(&(sc)->emac_mii_lock)
+#define	EMAC_MII_ASSERT_LOCKED(sc)	\
+    sx_assert(&(sc)->emac_mii_lock, SA_XLOCKED)
 
 #endif	/* __IF_EMACREG_H__ */
@@ -0,0 +1,89 @@
+/*-
+ * Copyright (c) 2015 The FreeBSD Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef	__IF_EMACVAR_H__
+#define	__IF_EMACVAR_H__
+
+/*
+ * Driver specific requests, passed in struct ifdrv with SIOCGDRVSPEC
+ * (get) or SIOCSDRVSPEC (set).
+ */
+#define	EMAC_CLS_GET_RULES	1	/* get: struct emac_cls_rule[] */
+#define	EMAC_CLS_SET_RULES	2	/* set: struct emac_cls_rule[] */
+#define	EMAC_CLS_SET_PROG	3	/* set: struct bpf_insn[] */
+#define	EMAC_SAF_GET		4	/* get: struct emac_saf */
+#define	EMAC_SAF_SET		5	/* set: struct emac_saf */
+
+/*
+ * Early receive classifier.  Rules are matched in order against the
+ * start of every received frame before a buffer is allocated for it;
+ * the first match decides.  Frames no rule matches are run through
+ * the optional BPF program, which only sees the first EMAC_CLS_PEEK
+ * bytes; a zero return drops the frame.  EMAC_CLS_SET_PROG refuses
+ * programs that load from past EMAC_CLS_PEEK or use indirect loads.
+ */
+#define	EMAC_CLS_MAXRULES	16
+#define	EMAC_CLS_MAXINSNS	64
+#define	EMAC_CLS_PEEK		64
+
+#define	EMAC_CLS_MATCH_DST	0x0001	/* destination is ecr_dst */
+#define	EMAC_CLS_MATCH_BCAST	0x0002	/* destination is broadcast */
+#define	EMAC_CLS_MATCH_MCAST	0x0004	/* destination is multicast */
+#define	EMAC_CLS_MATCH_TYPE	0x0008	/* EtherType is ecr_type */
+
+#define	EMAC_CLS_PASS		0
+#define	EMAC_CLS_DROP		1
+
+struct emac_cls_rule {
+	uint8_t		ecr_dst[6];
+	uint16_t	ecr_type;	/* host byte order */
+	uint16_t	ecr_match;	/* EMAC_CLS_MATCH_* */
+	uint16_t	ecr_action;	/* EMAC_CLS_PASS or EMAC_CLS_DROP */
+	uint64_t	ecr_hits;	/* frames matched, ignored on set */
+};
+
+/*
+ * Source address filter.  Lists of up to EMAC_SAF_SLOTS addresses are
+ * matched by the MAC, so rejected frames never reach the receive FIFO.
+ * Longer lists are matched by the classifier instead, ahead of its
+ * rules.
+ */
+#define	EMAC_SAF_SLOTS		4
+#define	EMAC_SAF_MAXADDRS	32
+
+#define	EMAC_SAF_OFF		0
+#define	EMAC_SAF_ALLOW		1	/* accept listed senders only */
+#define	EMAC_SAF_DENY		2	/* drop listed senders */
+
+struct emac_saf {
+	uint32_t	es_mode;	/* EMAC_SAF_* */
+	uint32_t	es_count;	/* entries used in es_addr */
+	uint8_t		es_addr[EMAC_SAF_MAXADDRS][6];
+};
+
+#endif	/* __IF_EMACVAR_H__ */